@@ -0,0 +1,299 @@
+// -*- C++ -*-
+//! \file       atomicfile.cc
+//! \brief      crash-safe atomic file replacement implementation.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include "atomicfile.hpp"
+#include "sysatomic.h"
+#include <cstdio>	// for std::sprintf
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace sys {
+
+namespace {
+
+// sync_data (FILE)
+// Effects: flushes data of the FILE to disk.
+
+result<void> sync_data (raw_handle file)
+{
+#if defined(_WIN32)
+    if (!::FlushFileBuffers (file))
+	return error_code::last();
+#elif defined(__linux__)
+    if (-1 == ::fdatasync (file))
+	return error_code::last();
+#else
+    if (-1 == ::fsync (file))
+	return error_code::last();
+#endif
+    return result<void>();
+}
+
+// temp_name (NAME)
+// Returns: name for a temporary file next to NAME, unique within process.
+
+string temp_name (const string& name)
+{
+    static sys::atomic<unsigned> counter;
+    char suffix[32];
+#ifdef _WIN32
+    unsigned long pid = ::GetCurrentProcessId();
+#else
+    unsigned long pid = ::getpid();
+#endif
+    std::sprintf (suffix, ".tmp%lu.%u", pid, counter.fetch_add (1, memory_order_relaxed));
+    string temp (1, '.');
+    temp += name;
+    temp += suffix;
+    return temp;
+}
+
+} // anonymous namespace
+
+// --- directory_sync --------------------------------------------------------
+
+directory_sync::
+~directory_sync ()
+{
+    try_sync();
+}
+
+result<void> directory_sync::
+try_sync ()
+{
+    result<void> rc;
+#ifndef _WIN32
+    for (std::set<string>::const_iterator it = m_dirs.begin(); it != m_dirs.end(); ++it)
+    {
+	directory dir;
+	result<void> sync_rc = dir.try_open (it->c_str());
+	if (sync_rc && -1 == ::fsync (dir.handle()))
+	    sync_rc = error_code::last();
+	if (!sync_rc && rc)
+	    rc = sync_rc;
+    }
+#endif
+    // directory entries are written through on Windows
+    m_dirs.clear();
+    return rc;
+}
+
+void directory_sync::
+sync ()
+{
+    result<void> rc = try_sync();
+    if (!rc)
+	throw generic_error (rc.error());
+}
+
+// --- atomic_file_writer ----------------------------------------------------
+
+atomic_file_writer::
+atomic_file_writer () : private_base(), std::ostream (&m_filebuf), m_dir_sync (0)
+{
+}
+
+atomic_file_writer::
+atomic_file_writer (const char* path, directory_sync* dir_sync)
+    : private_base(), std::ostream (&m_filebuf), m_dir_sync (0)
+{
+    open (path, dir_sync);
+}
+
+atomic_file_writer::
+~atomic_file_writer ()
+{
+    discard();
+}
+
+result<void> atomic_file_writer::
+try_open (const char* path, directory_sync* dir_sync)
+{
+    discard();
+
+    m_path = path;
+    size_t slash = m_path.find_last_of (
+#ifdef _WIN32
+	"\\/"
+#else
+	"/"
+#endif
+	);
+    string dir_name;
+    if (slash == string::npos)
+    {
+	dir_name = ".";
+	m_name = m_path;
+    }
+    else
+    {
+	dir_name.assign (m_path, 0, slash ? slash : 1);
+	m_name.assign (m_path, slash + 1, string::npos);
+    }
+    m_dir_sync = dir_sync;
+
+    result<void> rc = m_dir.try_open (dir_name.c_str());
+    if (rc)
+	rc = m_create_temp();
+    if (!rc)
+	m_dir.close();
+    return rc;
+}
+
+result<raw_handle> atomic_file_writer::
+m_open_named ()
+{
+#ifdef _WIN32
+    const int exists = ERROR_FILE_EXISTS;
+#else
+    const int exists = EEXIST;
+#endif
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+	m_temp = temp_name (m_name);
+	result<raw_handle> file =
+	    m_dir.try_open_at (m_temp.c_str(),
+			       sys::io::win_to_sys (sys::io::generic_write, sys::io::create_new),
+			       sys::io::share_none);
+	if (file || file.error() != exists)
+	{
+	    if (!file)
+		m_temp.clear();
+	    return file;
+	}
+    }
+    m_temp.clear();
+    return error_code (exists);
+}
+
+result<void> atomic_file_writer::
+m_create_temp ()
+{
+#if defined(__linux__) && defined(O_TMPFILE)
+    // unnamed file is never left behind, even if process is killed;
+    // filesystems without O_TMPFILE support get a named one
+    result<raw_handle> file = m_dir.try_open_at (".", O_TMPFILE | O_WRONLY | O_CLOEXEC);
+    if (!file)
+	file = m_open_named();
+#else
+    result<raw_handle> file = m_open_named();
+#endif
+    if (!file)
+	return error_code (file.error());
+#ifndef _WIN32
+    if (result<file::status> st = m_dir.try_stat_at (m_name.c_str(), true, file::status_mode))
+	::fchmod (*file, st->mode);
+#endif
+    m_filebuf.attach (*file, std::ios::out | std::ios::binary);
+    return result<void>();
+}
+
+result<void> atomic_file_writer::
+m_link_temp ()
+{
+#if defined(__linux__) && defined(O_TMPFILE)
+    // linkat with AT_EMPTY_PATH needs CAP_DAC_READ_SEARCH, link through /proc
+    char proc_path[32];
+    std::sprintf (proc_path, "/proc/self/fd/%d", handle());
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+	string temp = temp_name (m_name);
+	if (0 == ::linkat (AT_FDCWD, proc_path, m_dir.handle(), temp.c_str(), AT_SYMLINK_FOLLOW))
+	{
+	    m_temp = temp;
+	    return result<void>();
+	}
+	if (errno != EEXIST)
+	    break;
+    }
+    return error_code::last();
+#else
+    return error_code (EINVAL);	// not reached, files are always named
+#endif
+}
+
+result<void> atomic_file_writer::
+try_commit ()
+{
+    if (!is_open())
+	return error_code (EBADF);
+
+    result<void> rc;
+    errno = 0;
+    if (m_filebuf.pubsync() != 0 || bad())
+	rc = error_code (errno ? errno : EIO);
+    if (rc)
+	rc = sync_data (handle());
+    if (rc && m_temp.empty())
+	rc = m_link_temp();
+    if (rc && !m_filebuf.close())
+	rc = error_code::last();
+    if (rc)
+	rc = m_dir.try_rename_at (m_temp.c_str(), m_name.c_str());
+    if (!rc)
+    {
+	discard();
+	return rc;
+    }
+    m_temp.clear();
+
+#ifndef _WIN32
+    if (m_dir_sync)
+	m_dir_sync->add (m_dir.path());
+    else if (-1 == ::fsync (m_dir.handle()))
+	rc = error_code::last();
+#endif
+    m_dir.close();
+    return rc;
+}
+
+void atomic_file_writer::
+commit ()
+{
+    result<void> rc = try_commit();
+    if (!rc)
+	throw file_error (rc.error(), m_path.c_str());
+}
+
+void atomic_file_writer::
+discard ()
+{
+    m_filebuf.close();
+    if (!m_temp.empty())
+    {
+	m_dir.try_unlink_at (m_temp.c_str());
+	m_temp.clear();
+    }
+    m_dir.close();
+}
+
+} // namespace sys
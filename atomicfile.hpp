@@ -0,0 +1,169 @@
+// -*- C++ -*-
+//! \file       atomicfile.hpp
+//! \brief      crash-safe atomic file replacement.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef SYS_ATOMICFILE_HPP
+#define SYS_ATOMICFILE_HPP
+
+#include "sysdef.h"
+#include "fstream.hpp"
+#include "sysfs.h"	// for sys::directory
+#include <set>
+
+namespace sys {
+
+// ---------------------------------------------------------------------------
+/// \class directory_sync
+/// \brief directory synchronization shared by several file commits.
+///
+/// atomic_file_writer commits that refer to directory_sync leave fsync of the
+/// directory to it, so that committing many files costs one fsync per
+/// distinct directory instead of one per file.  Until sync() returns, renames
+/// made by such commits may be lost on crash, although each file is seen
+/// either with the old or with the new contents.
+
+class SYSPP_DLLIMPORT directory_sync
+{
+public:
+    directory_sync () { }
+
+    // dtor
+    // Effects: synchronizes pending directories, ignoring errors.
+    ~directory_sync ();
+
+    // add (PATH)
+    // Effects: schedules directory PATH for synchronization.
+    void add (const string& path) { m_dirs.insert (path); }
+
+    size_t pending () const { return m_dirs.size(); }
+
+    // try_sync ()
+    // Effects: flushes entries of the scheduled directories to disk.
+    // Returns: first system error code encountered.
+    result<void> try_sync ();
+
+    // sync ()
+    // Throws: sys::file_error if some directory could not be synchronized.
+    void sync ();
+
+private:
+    directory_sync (const directory_sync&);		// not defined
+    directory_sync& operator= (const directory_sync&);	// not defined
+
+    std::set<string>	m_dirs;
+};
+
+// ---------------------------------------------------------------------------
+/// \class atomic_file_writer
+/// \brief output file stream that replaces the target file atomically.
+///
+/// Data is written into a temporary file within the target directory: an
+/// unnamed O_TMPFILE file on Linux, a uniquely named file elsewhere.  commit()
+/// flushes the data to disk, renames the temporary file over the target, and
+/// synchronizes the directory, so that after a crash the target holds either
+/// old or new contents in full.  Temporary file is removed if the writer is
+/// destroyed without commit.  Permissions of the existing target are retained.
+
+class SYSPP_DLLIMPORT atomic_file_writer : private detail::fstream_base, public std::ostream
+{
+public:
+    typedef detail::fstream_base	private_base;
+
+    atomic_file_writer ();
+
+    // atomic_file_writer (PATH, DIR_SYNC)
+    // Effects: opens temporary file to replace PATH; sets failbit on failure.
+    //          Directory synchronization on commit is left to DIR_SYNC, if
+    //          it is not null.
+    explicit atomic_file_writer (const char* path, directory_sync* dir_sync = 0);
+
+    template <typename Ch, typename Tr, typename Al>
+    explicit atomic_file_writer (const basic_string<Ch,Tr,Al>& path,
+				 directory_sync* dir_sync = 0);
+
+    // dtor
+    // Effects: discards uncommitted data.
+    ~atomic_file_writer ();
+
+    // try_open (PATH, DIR_SYNC)
+    // Returns: system error code if temporary file could not be created.
+    result<void> try_open (const char* path, directory_sync* dir_sync = 0);
+
+    void open (const char* path, directory_sync* dir_sync = 0)
+	{
+	    if (try_open (path, dir_sync))
+		clear();
+	    else
+		setstate (std::ios::failbit);
+	}
+
+    // try_commit ()
+    // Effects: flushes written data to disk and atomically replaces target
+    //          file with it.  Writer is closed whether commit succeeded or not.
+    // Returns: system error code on failure, target file is intact then.
+    result<void> try_commit ();
+
+    // commit ()
+    // Throws: sys::file_error on failure.
+    void commit ();
+
+    // discard ()
+    // Effects: closes writer and removes temporary file.
+    void discard ();
+
+    // path ()
+    // Returns: path of the target file.
+    const string& path () const { return m_path; }
+
+    using private_base::is_open;
+    using private_base::rdbuf;
+    using private_base::handle;
+
+private:
+    atomic_file_writer (const atomic_file_writer&);		// not defined
+    atomic_file_writer& operator= (const atomic_file_writer&);	// not defined
+
+    result<raw_handle> m_open_named ();
+    result<void> m_create_temp ();
+    result<void> m_link_temp ();
+
+    directory		m_dir;
+    string		m_path;		// target path
+    string		m_name;		// target name within m_dir
+    string		m_temp;		// temporary name, empty while unnamed
+    directory_sync*	m_dir_sync;
+};
+
+template <typename Ch, typename Tr, typename Al>
+atomic_file_writer::
+atomic_file_writer (const basic_string<Ch,Tr,Al>& path, directory_sync* dir_sync)
+    : private_base(), std::ostream (&m_filebuf), m_dir_sync (0)
+{
+    open (path.c_str(), dir_sync);
+}
+
+} // namespace sys
+
+#endif /* SYS_ATOMICFILE_HPP */
@@ -25,10 +25,8 @@
 //
 
 #include "fstream.hpp"
-
-#if SYSPP_FSTREAM_TEXT_MODE
-#include <algorithm>	// for std::count
-#endif
+#include "sysfs.h"	// for sys::file::try_preallocate
+#include <algorithm>	// for std::count, std::max
 
 #ifndef _WIN32
 #include <sys/types.h>
@@ -50,12 +48,37 @@ close ()
 	return NULL;
 
     m_sync();
+#ifndef _WIN32
+    // blocks preallocated past the end of file are kept until truncation,
+    // while NTFS releases them on close by itself
+    if (m_reserved)
+    {
+	file::size_type size = file::get_size (m_handle);
+	if (size != file::invalid_size && size < m_reserved)
+	    ::ftruncate (m_handle, size);
+    }
+#endif
     bool rc = m_handle.close();
     m_mode = std::ios::openmode(0);
 
     return (rc ? this : NULL);
 }
 
+bool filebuf::
+reserve (std::streamsize size)
+{
+    if (!is_open() || !(m_mode & std::ios::out) || size <= 0)
+	return false;
+    off_type pos = m_seek (0, std::ios::cur);
+    if (pos == off_type (-1))
+	return false;
+    pos += pptr() - pbase();
+    if (!file::try_preallocate (m_handle, pos, size, true))
+	return false;
+    m_reserved = std::max<off_type> (m_reserved, pos + size);
+    return true;
+}
+
 filebuf::streambuf_type* filebuf::
 setbuf (char_type* buf, std::streamsize size)
 {
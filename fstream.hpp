@@ -32,6 +32,7 @@
 #include "sysdef.h"
 #include "sysio.h"	// for sys::io constants
 #include "sysstring.h"
+#include "timer.hpp"	// for SYSPP_TIMED_SCOPE
 #include <streambuf>	// for std::streambuf
 #include <iostream>	// for std::istream and std::ostream
 #include <cstdio>	// for BUFSIZ
@@ -62,7 +63,8 @@ public: // types
 public: // methods
 
     filebuf () : m_handle (), m_mode (std::ios::openmode(0)),
-		 m_buf (0), m_buf_size (0), m_cur_gsize (), m_buf_allocated (false)
+		 m_buf (0), m_buf_size (0), m_cur_gsize (), m_reserved (0),
+		 m_buf_allocated (false)
 	{ }
     virtual ~filebuf ();
 
@@ -79,8 +81,24 @@ public: // methods
 		   sys::io::win_sharemode share = sys::io::share_default)
 	{ return open (filename.c_str(), mode, ex_mode, share); }
 
+    // attach (HANDLE, MODE)
+    // Effects: associates buffer with file HANDLE opened in MODE; HANDLE is
+    //          closed by close().
+    // Returns: this, or NULL if buffer is already open or HANDLE is invalid.
+
+    filebuf* attach (sys::raw_handle handle, std::ios::openmode mode);
+
     filebuf* close ();
 
+    // reserve (SIZE)
+    // Effects: hints that SIZE more bytes are going to be written past the
+    //          current position and preallocates disk space for them, so the
+    //          file is not grown block by block.  File size is not changed;
+    //          space left unused is released by close().
+    // Returns: true if space was preallocated.
+
+    bool reserve (std::streamsize size);
+
     // handle()
     //
     // Returns: underlying system file handle.
@@ -191,6 +209,7 @@ private: // data
     char_type*			m_buf;
     size_t			m_buf_size;	// allocated buffer size
     std::streamsize		m_cur_gsize;	// size of input buffer area
+    off_type			m_reserved;	// end of preallocated area
     bool			m_buf_allocated;
     char_type			m_putback;
 };
@@ -435,10 +454,19 @@ open (const CharT* filename, std::ios::openmode mode,
     else
 	sys_mode = sys::io::ios_to_sys (mode);
 
-    m_handle = create_file (filename, sys_mode, share);
-    if (!m_handle)
+    sys::raw_handle handle = create_file (filename, sys_mode, share);
+    if (!file_handle::valid (handle))
 	return NULL;
 
+    return attach (handle, mode);
+}
+
+inline filebuf* filebuf::
+attach (sys::raw_handle handle, std::ios::openmode mode)
+{
+    if (is_open() || !file_handle::valid (handle)) return NULL;
+
+    m_handle = handle;
     if (!m_buf)
     {
 	m_buf = new char_type[default_bufsize];
@@ -446,6 +474,7 @@ open (const CharT* filename, std::ios::openmode mode,
 	m_buf_size = default_bufsize;
     }
     m_mode = mode;
+    m_reserved = 0;
     m_init();
 
     if (mode & (std::ios::ate))
@@ -459,6 +488,7 @@ open (const CharT* filename, std::ios::openmode mode,
 inline std::streamsize filebuf::
 m_readfile (char_type* buf, std::streamsize size)
 {
+    SYSPP_TIMED_SCOPE ("sys::filebuf::read");
 #if SYSPP_FSTREAM_TEXT_MODE
     if (!(m_mode & std::ios::binary))
 	return m_read_text (buf, size);
@@ -469,6 +499,7 @@ m_readfile (char_type* buf, std::streamsize size)
 inline std::streamsize filebuf::
 m_writefile (const char_type* buf, std::streamsize size)
 {
+    SYSPP_TIMED_SCOPE ("sys::filebuf::write");
     if (m_mode & std::ios::app)
 	m_seek (0, std::ios::end);
 #if SYSPP_FSTREAM_TEXT_MODE
@@ -500,12 +531,14 @@ m_write_text (const char_type* buf, std::streamsize size)
 inline std::streamsize filebuf::
 m_readfile (char_type* buf, std::streamsize size)
 {
+    SYSPP_TIMED_SCOPE ("sys::filebuf::read");
     return sys::read_file (m_handle, buf, size);
 }
 
 inline std::streamsize filebuf::
 m_writefile (const char_type* buf, std::streamsize size)
 {
+    SYSPP_TIMED_SCOPE ("sys::filebuf::write");
     return sys::write_file (m_handle, buf, size);
 }
 
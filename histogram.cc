@@ -0,0 +1,291 @@
+// -*- C++ -*-
+//! \file       histogram.cc
+//! \brief      latency histogram implementation.
+//
+// Copyright (C) 2007 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#include "histogram.hpp"
+#include <vector>
+#include <cmath>		// for std::ceil
+
+namespace sys {
+
+namespace detail {
+
+atomic<latency_histogram*> latency_probes[probe_count];
+
+} // namespace detail
+
+namespace {
+
+// highest_bit (VALUE)
+// Returns: index of the most significant bit set in non-zero VALUE.
+
+inline unsigned highest_bit (boost::uint64_t value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll (value);
+#else
+    unsigned bit = 0;
+    while (value >>= 1)
+	++bit;
+    return bit;
+#endif
+}
+
+// thread_stripe ()
+// Returns: stripe index assigned to the calling thread.
+
+size_t thread_stripe ()
+{
+    static uatomic32 next_index;
+    static thread_local size_t index
+	= next_index.fetch_add (1, memory_order_relaxed) % latency_histogram::stripe_count;
+    return index;
+}
+
+} // anonymous namespace
+
+struct latency_histogram::stripe
+{
+    uatomic64	counts[bucket_count];
+    uatomic64	sum;
+    uatomic64	min;
+    uatomic64	max;
+
+    stripe () : min (~value_type (0)) { }
+};
+
+latency_histogram::
+latency_histogram ()
+{
+}
+
+latency_histogram::
+~latency_histogram ()
+{
+    for (size_t i = 0; i < stripe_count; ++i)
+	delete m_stripes[i].load (memory_order_relaxed);
+}
+
+size_t latency_histogram::
+bucket_index (value_type value)
+{
+    if (value < sub_bucket_count)
+	return size_t (value);
+    unsigned msb = highest_bit (value);
+    unsigned shift = msb - sub_bucket_bits + 1;
+    return sub_bucket_count + (msb - sub_bucket_bits) * (sub_bucket_count / 2)
+	+ size_t (value >> shift) - sub_bucket_count / 2;
+}
+
+latency_histogram::value_type latency_histogram::
+bucket_lower (size_t index)
+{
+    if (index < sub_bucket_count)
+	return value_type (index);
+    index -= sub_bucket_count;
+    unsigned shift = unsigned (index / (sub_bucket_count / 2)) + 1;
+    value_type sub = index % (sub_bucket_count / 2) + sub_bucket_count / 2;
+    return sub << shift;
+}
+
+latency_histogram::value_type latency_histogram::
+bucket_upper (size_t index)
+{
+    if (index + 1 >= bucket_count)
+	return ~value_type (0);
+    return bucket_lower (index + 1) - 1;
+}
+
+latency_histogram::stripe& latency_histogram::
+m_local_stripe ()
+{
+    atomic<stripe*>& slot = m_stripes[thread_stripe()];
+    stripe* s = slot.load (memory_order_acquire);
+    if (!s)
+    {
+	stripe* fresh = new stripe;
+	if (slot.compare_exchange (s, fresh, memory_order_acq_rel, memory_order_acquire))
+	    s = fresh;
+	else
+	    delete fresh;	// another thread installed the stripe first
+    }
+    return *s;
+}
+
+void latency_histogram::
+record (value_type value)
+{
+    stripe& s = m_local_stripe();
+    s.counts[bucket_index (value)].fetch_add (1, memory_order_relaxed);
+    s.sum.fetch_add (value, memory_order_relaxed);
+
+    value_type cur = s.min.load (memory_order_relaxed);
+    while (value < cur && !s.min.compare_exchange_weak (cur, value, memory_order_relaxed,
+							 memory_order_relaxed))
+	;
+    cur = s.max.load (memory_order_relaxed);
+    while (value > cur && !s.max.compare_exchange_weak (cur, value, memory_order_relaxed,
+							 memory_order_relaxed))
+	;
+}
+
+void latency_histogram::
+merge (const latency_histogram& other)
+{
+    if (&other == this)
+	return;
+    stripe& dst = m_local_stripe();
+    for (size_t i = 0; i < stripe_count; ++i)
+    {
+	const stripe* src = other.m_stripes[i].load (memory_order_acquire);
+	if (!src)
+	    continue;
+	for (size_t b = 0; b < bucket_count; ++b)
+	    if (count_type n = src->counts[b].load (memory_order_relaxed))
+		dst.counts[b].fetch_add (n, memory_order_relaxed);
+	dst.sum.fetch_add (src->sum.load (memory_order_relaxed), memory_order_relaxed);
+
+	value_type value = src->min.load (memory_order_relaxed);
+	value_type cur = dst.min.load (memory_order_relaxed);
+	while (value < cur && !dst.min.compare_exchange_weak (cur, value, memory_order_relaxed,
+							       memory_order_relaxed))
+	    ;
+	value = src->max.load (memory_order_relaxed);
+	cur = dst.max.load (memory_order_relaxed);
+	while (value > cur && !dst.max.compare_exchange_weak (cur, value, memory_order_relaxed,
+							       memory_order_relaxed))
+	    ;
+    }
+}
+
+void latency_histogram::
+reset ()
+{
+    for (size_t i = 0; i < stripe_count; ++i)
+    {
+	stripe* s = m_stripes[i].load (memory_order_acquire);
+	if (!s)
+	    continue;
+	for (size_t b = 0; b < bucket_count; ++b)
+	    s->counts[b].store (0, memory_order_relaxed);
+	s->sum.store (0, memory_order_relaxed);
+	s->min.store (~value_type (0), memory_order_relaxed);
+	s->max.store (0, memory_order_relaxed);
+    }
+}
+
+latency_histogram::count_type latency_histogram::
+count () const
+{
+    count_type total = 0;
+    for (size_t i = 0; i < stripe_count; ++i)
+	if (const stripe* s = m_stripes[i].load (memory_order_acquire))
+	    for (size_t b = 0; b < bucket_count; ++b)
+		total += s->counts[b].load (memory_order_relaxed);
+    return total;
+}
+
+latency_histogram::value_type latency_histogram::
+min () const
+{
+    value_type result = ~value_type (0);
+    for (size_t i = 0; i < stripe_count; ++i)
+	if (const stripe* s = m_stripes[i].load (memory_order_acquire))
+	{
+	    value_type value = s->min.load (memory_order_relaxed);
+	    if (value < result)
+		result = value;
+	}
+    return result == ~value_type (0) ? 0 : result;
+}
+
+latency_histogram::value_type latency_histogram::
+max () const
+{
+    value_type result = 0;
+    for (size_t i = 0; i < stripe_count; ++i)
+	if (const stripe* s = m_stripes[i].load (memory_order_acquire))
+	{
+	    value_type value = s->max.load (memory_order_relaxed);
+	    if (value > result)
+		result = value;
+	}
+    return result;
+}
+
+double latency_histogram::
+mean () const
+{
+    double sum = 0;
+    for (size_t i = 0; i < stripe_count; ++i)
+	if (const stripe* s = m_stripes[i].load (memory_order_acquire))
+	    sum += s->sum.load (memory_order_relaxed);
+    count_type total = count();
+    return total ? sum / total : 0.0;
+}
+
+latency_histogram::value_type latency_histogram::
+percentile (double p) const
+{
+    std::vector<count_type> counts (bucket_count);
+    count_type total = 0;
+    for (size_t i = 0; i < stripe_count; ++i)
+	if (const stripe* s = m_stripes[i].load (memory_order_acquire))
+	    for (size_t b = 0; b < bucket_count; ++b)
+	    {
+		count_type n = s->counts[b].load (memory_order_relaxed);
+		counts[b] += n;
+		total += n;
+	    }
+    if (!total)
+	return 0;
+    if (p <= 0)
+	return min();
+
+    count_type rank = count_type (std::ceil (p / 100 * total));
+    if (rank < 1)
+	rank = 1;
+    if (rank > total)
+	rank = total;
+    count_type seen = 0;
+    for (size_t b = 0; b < bucket_count; ++b)
+    {
+	seen += counts[b];
+	if (seen >= rank)
+	{
+	    value_type upper = bucket_upper (b);
+	    value_type highest = max();
+	    return upper < highest ? upper : highest;
+	}
+    }
+    return max();
+}
+
+void
+set_latency_probe (latency_probe probe, latency_histogram* hist)
+{
+    detail::latency_probes[probe].store (hist, memory_order_release);
+}
+
+} // namespace sys
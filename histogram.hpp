@@ -0,0 +1,190 @@
+// -*- C++ -*-
+//! \file       histogram.hpp
+//! \brief      latency histogram with percentile queries.
+//
+// Copyright (C) 2007 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#ifndef SYS_HISTOGRAM_HPP
+#define SYS_HISTOGRAM_HPP
+
+#include "sysdef.h"
+#include "timer.hpp"		// for sys::cycle_clock
+#include "sysatomic.h"
+#include <boost/cstdint.hpp>	// for boost::uint64_t
+
+namespace sys {
+
+// ---------------------------------------------------------------------------
+/// \class latency_histogram
+/// \brief distribution of durations, in nanoseconds.
+///
+/// Values are counted in log-linear buckets: first 64 values have buckets of
+/// their own, every following power of two range is split into 32 buckets,
+/// which bounds relative error of reported percentiles by 1/32 over the whole
+/// 64-bit range.
+///
+/// Recording is lock-free.  Each thread updates its own stripe of counters,
+/// stripes are allocated on first use and are summed up by queries, so
+/// recording threads never contend unless there are more threads than
+/// stripes.
+
+class SYSPP_DLLIMPORT latency_histogram
+{
+public:
+    typedef boost::uint64_t	value_type;
+    typedef boost::uint64_t	count_type;
+
+    SYSPP_static_constexpr unsigned sub_bucket_bits = 6;
+    SYSPP_static_constexpr size_t sub_bucket_count = size_t (1) << sub_bucket_bits;
+    SYSPP_static_constexpr size_t bucket_count
+	= sub_bucket_count + (64 - sub_bucket_bits) * (sub_bucket_count / 2);
+    SYSPP_static_constexpr size_t stripe_count = 8;
+
+    latency_histogram ();
+    ~latency_histogram ();
+
+    // record (VALUE)
+    // Effects: accounts one sample of VALUE nanoseconds.
+
+    void record (value_type value);
+    void record (cycle_clock::duration value) { record (value_type (value.count())); }
+
+    // merge (OTHER)
+    // Effects: adds samples recorded in OTHER to this histogram.
+
+    void merge (const latency_histogram& other);
+
+    // reset ()
+    // Effects: discards all samples.  Samples recorded concurrently could be
+    //          partially lost.
+
+    void reset ();
+
+    count_type count () const;
+
+    value_type min () const;
+    value_type max () const;
+    double mean () const;
+
+    // percentile (P)
+    // Returns: value below or equal to which P percent of samples fall,
+    //          within the precision of the buckets; 0 if histogram is empty.
+
+    value_type percentile (double p) const;
+
+    // bucket_index (VALUE)
+    // Returns: index of the bucket VALUE falls into.
+
+    static size_t bucket_index (value_type value);
+
+    // bucket_lower (INDEX), bucket_upper (INDEX)
+    // Returns: range of values counted in the bucket INDEX.
+
+    static value_type bucket_lower (size_t index);
+    static value_type bucket_upper (size_t index);
+
+private:
+    struct stripe;
+
+    latency_histogram (const latency_histogram&);		// not defined
+    latency_histogram& operator= (const latency_histogram&);	// not defined
+
+    // m_local_stripe ()
+    // Returns: stripe of the calling thread, allocated if necessary.
+    stripe& m_local_stripe ();
+
+    atomic<stripe*>	m_stripes[stripe_count];
+};
+
+// ---------------------------------------------------------------------------
+// latency probes of the library I/O functions.
+
+enum latency_probe
+{
+    probe_read,		// sys::read_file, sys::try_read_file
+    probe_write,	// sys::write_file, sys::try_write_file
+    probe_map,		// memory mapping of a file view
+    probe_count
+};
+
+namespace detail {
+
+SYSPP_DLLIMPORT extern atomic<latency_histogram*> latency_probes[probe_count];
+
+} // namespace detail
+
+// set_latency_probe (PROBE, HIST)
+// Effects: starts recording latencies of operations of kind PROBE into
+//          histogram HIST, or stops recording if HIST is null.  Histogram
+//          should outlive any operation started while it was set.  Only
+//          operations compiled with SYSPP_ENABLE_TIMING are recorded.
+
+SYSPP_DLLIMPORT void set_latency_probe (latency_probe probe, latency_histogram* hist);
+
+/// \class latency_scope
+/// \brief records time spent within its lifetime into latency_histogram.
+///
+/// Constructed with a probe that is not set, it costs a single load.
+
+class latency_scope
+{
+public:
+    explicit latency_scope (latency_histogram* hist)
+	: m_hist (hist), m_start (hist ? cycle_clock::now() : 0) { }
+
+    explicit latency_scope (latency_histogram& hist)
+	: m_hist (&hist), m_start (cycle_clock::now()) { }
+
+    explicit latency_scope (latency_probe probe)
+	: m_hist (detail::latency_probes[probe].load (memory_order_acquire))
+	, m_start (m_hist ? cycle_clock::now() : 0) { }
+
+    ~latency_scope ()
+	{
+	    if (m_hist)
+		m_hist->record (cycle_clock::to_duration (cycle_clock::now() - m_start));
+	}
+
+private:
+    latency_scope (const latency_scope&);		// not defined
+    latency_scope& operator= (const latency_scope&);	// not defined
+
+    latency_histogram*		m_hist;
+    cycle_clock::tick_type	m_start;
+};
+
+} // namespace sys
+
+// SYSPP_LATENCY_SCOPE (PROBE)
+// Effects: records time spent in the rest of enclosing scope by latency
+//          probe sys::PROBE.  Like SYSPP_TIMED_SCOPE, expands to nothing
+//          unless SYSPP_ENABLE_TIMING is defined, so that users of the I/O
+//          headers neither link histogram.cc nor pay for the probe check.
+
+#ifdef SYSPP_ENABLE_TIMING
+#define SYSPP_LATENCY_SCOPE(probe) \
+    ::sys::latency_scope syspp_latency_scope_ (::sys::probe)
+#elif !defined(SYSPP_LATENCY_SCOPE)
+#define SYSPP_LATENCY_SCOPE(probe)
+#endif
+
+#endif /* SYS_HISTOGRAM_HPP */
@@ -31,11 +31,29 @@
 #include <string>	// for std::string
 #include <algorithm>	// for std::transform
 #include <locale>	// for std::locale
+#include <cstddef>	// for std::size_t
+#include <cstring>	// for std::memcpy, std::strlen
+#include <cstdint>	// for std::uint64_t
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define ICASE_STRING_VIEW 1
+#else
+#define ICASE_STRING_VIEW 0
+#endif
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <strings.h>
 #endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ICASE_SSE2 1
+#else
+#define ICASE_SSE2 0
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>	// for _BitScanForward, _umul128
+#endif
 
 #if defined(__MINGW32__) && !defined(LOCALE_INVARIANT)
 #define LOCALE_INVARIANT                                                      \
@@ -46,6 +64,297 @@ namespace icase {
 
 typedef std::string::traits_type	traits_type;
 
+// ---------------------------------------------------------------------------
+// ASCII case folding.
+//
+// ASCII characters are folded through lookup tables, regardless of the current
+// C locale; std::toupper/std::tolower are called only for non-ASCII characters.
+// Blocks of pure ASCII text are compared and converted 16 bytes at a time where
+// SSE2 is available.
+
+namespace detail {
+
+template <typename Dummy = void>
+struct fold_tables
+{
+    static const unsigned char upper[128];
+    static const unsigned char lower[128];
+};
+
+template <typename Dummy>
+const unsigned char fold_tables<Dummy>::upper[128] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	0x60, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+};
+
+template <typename Dummy>
+const unsigned char fold_tables<Dummy>::lower[128] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+};
+
+/// toupper/tolower (C)
+/// \brief single character case conversion, C is an unsigned char value.
+
+inline int toupper (int c)
+{
+    return c < 0x80? fold_tables<>::upper[c]: std::toupper (c);
+}
+
+inline int tolower (int c)
+{
+    return c < 0x80? fold_tables<>::lower[c]: std::tolower (c);
+}
+
+inline int toupper (char c)
+{
+    return toupper (traits_type::to_int_type (c));
+}
+
+inline int tolower (char c)
+{
+    return tolower (traits_type::to_int_type (c));
+}
+
+// first_bit (MASK)
+// Returns: index of the lowest set bit in non-zero MASK.
+
+inline unsigned first_bit (unsigned mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward (&index, mask);
+    return index;
+#elif defined(__GNUC__)
+    return __builtin_ctz (mask);
+#else
+    unsigned index = 0;
+    for ( ; !(mask & 1); mask >>= 1)
+	++index;
+    return index;
+#endif
+}
+
+#if ICASE_SSE2
+
+// fold_upper (V)
+// Returns: V with lower-case ASCII letters converted to upper case.
+// Requires: all bytes of V are ASCII.
+
+inline __m128i fold_upper (__m128i v)
+{
+    __m128i is_lower = _mm_and_si128 (_mm_cmpgt_epi8 (v, _mm_set1_epi8 ('a'-1)),
+				      _mm_cmplt_epi8 (v, _mm_set1_epi8 ('z'+1)));
+    return _mm_sub_epi8 (v, _mm_and_si128 (is_lower, _mm_set1_epi8 (0x20)));
+}
+
+inline __m128i fold_lower (__m128i v)
+{
+    __m128i is_upper = _mm_and_si128 (_mm_cmpgt_epi8 (v, _mm_set1_epi8 ('A'-1)),
+				      _mm_cmplt_epi8 (v, _mm_set1_epi8 ('Z'+1)));
+    return _mm_add_epi8 (v, _mm_and_si128 (is_upper, _mm_set1_epi8 (0x20)));
+}
+
+#endif // ICASE_SSE2
+
+// mismatch (LHS, RHS, N)
+// Returns: index of the first character within N-character sequences LHS and RHS
+//          that differs case-insensitively, or N if sequences are equal.
+
+inline std::size_t mismatch (const char* lhs, const char* rhs, std::size_t n)
+{
+    std::size_t i = 0;
+#if ICASE_SSE2
+    for ( ; n - i >= 16; i += 16)
+    {
+	__m128i l = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (lhs+i));
+	__m128i r = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (rhs+i));
+	unsigned eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (l, r));
+	if (eq == 0xffff)
+	    continue;
+	if (_mm_movemask_epi8 (_mm_or_si128 (l, r)))
+	{
+	    // non-ASCII characters within block
+	    for (std::size_t end = i + 16; i != end; ++i)
+		if (toupper (lhs[i]) != toupper (rhs[i]))
+		    return i;
+	    i -= 16;
+	    continue;
+	}
+	eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (fold_upper (l), fold_upper (r)));
+	if (eq != 0xffff)
+	    return i + first_bit (~eq);
+    }
+#endif
+    for ( ; i != n; ++i)
+    {
+	if (lhs[i] != rhs[i] && toupper (lhs[i]) != toupper (rhs[i]))
+	    return i;
+    }
+    return n;
+}
+
+// compare (LHS, RHS, N)
+// Returns: negative value, zero or positive value if N-character sequence LHS is
+//          less, equal or greater than RHS, case-insensitively.
+
+inline int compare (const char* lhs, const char* rhs, std::size_t n)
+{
+    std::size_t i = mismatch (lhs, rhs, n);
+    if (i == n)
+	return 0;
+    return toupper (lhs[i]) - toupper (rhs[i]);
+}
+
+// transform_upper (S, N)
+// transform_lower (S, N)
+// Effects: convert N characters of the sequence S to upper/lower case in place.
+
+inline void transform_upper (char* s, std::size_t n)
+{
+    std::size_t i = 0;
+#if ICASE_SSE2
+    for ( ; n - i >= 16; i += 16)
+    {
+	__m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s+i));
+	if (_mm_movemask_epi8 (v))
+	    break;
+	_mm_storeu_si128 (reinterpret_cast<__m128i*> (s+i), fold_upper (v));
+    }
+#endif
+    for ( ; i != n; ++i)
+	s[i] = traits_type::to_char_type (toupper (s[i]));
+}
+
+inline void transform_lower (char* s, std::size_t n)
+{
+    std::size_t i = 0;
+#if ICASE_SSE2
+    for ( ; n - i >= 16; i += 16)
+    {
+	__m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s+i));
+	if (_mm_movemask_epi8 (v))
+	    break;
+	_mm_storeu_si128 (reinterpret_cast<__m128i*> (s+i), fold_lower (v));
+    }
+#endif
+    for ( ; i != n; ++i)
+	s[i] = traits_type::to_char_type (tolower (s[i]));
+}
+
+// ---------------------------------------------------------------------------
+// case-folding hash function.
+//
+// Input is consumed 8 bytes at a time; pure ASCII words are folded to upper case
+// with a bitwise trick, words containing non-ASCII bytes are folded bytewise
+// exactly as eqstr does.  Words are mixed by 64x64->128 bit multiplication in
+// the manner of wyhash.
+
+// fold_upper64 (W)
+// Returns: W with every byte converted to upper case.
+
+inline std::uint64_t fold_upper64 (std::uint64_t w)
+{
+    const std::uint64_t ones = 0x0101010101010101ull;
+    const std::uint64_t high = 0x8080808080808080ull;
+    if (w & high)
+    {
+	unsigned char bytes[8];
+	std::memcpy (bytes, &w, 8);
+	for (int i = 0; i < 8; ++i)
+	    bytes[i] = static_cast<unsigned char> (toupper (int (bytes[i])));
+	std::memcpy (&w, bytes, 8);
+	return w;
+    }
+    // high bit of each byte is set if byte is within ['a', 'z'] range
+    std::uint64_t is_lower = (w + ones * (0x80 - 'a')) & ~(w + ones * (0x80 - 'z' - 1)) & high;
+    return w ^ (is_lower >> 2);
+}
+
+inline std::uint64_t load64 (const char* p)
+{
+    std::uint64_t w;
+    std::memcpy (&w, p, 8);
+    return w;
+}
+
+// load_tail (P, N)
+// Returns: N < 8 bytes at P, zero-padded to a 64-bit word.
+
+inline std::uint64_t load_tail (const char* p, std::size_t n)
+{
+    std::uint64_t w = 0;
+    std::memcpy (&w, p, n);
+    return w;
+}
+
+// mix (A, B)
+// Returns: xor of the high and low halves of 128-bit product A*B.
+
+inline std::uint64_t mix (std::uint64_t a, std::uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128> (a) * b;
+    return static_cast<std::uint64_t> (r) ^ static_cast<std::uint64_t> (r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    std::uint64_t hi, lo = _umul128 (a, b, &hi);
+    return lo ^ hi;
+#else
+    std::uint64_t a_hi = a >> 32, a_lo = a & 0xffffffff;
+    std::uint64_t b_hi = b >> 32, b_lo = b & 0xffffffff;
+    std::uint64_t hh = a_hi * b_hi, hl = a_hi * b_lo, lh = a_lo * b_hi, ll = a_lo * b_lo;
+    std::uint64_t t = ll + (hl << 32);
+    std::uint64_t carry = t < ll;
+    std::uint64_t lo = t + (lh << 32);
+    carry += lo < t;
+    std::uint64_t hi = hh + (hl >> 32) + (lh >> 32) + carry;
+    return lo ^ hi;
+#endif
+}
+
+// hash_bytes (P, N, SEED)
+// Returns: case-insensitive hash value of N-byte sequence P.
+// Note: both operands of each round are keyed by the seed-derived secrets, so
+//       input block that cancels a constant could not zero out the state.
+
+inline std::uint64_t hash_bytes (const char* p, std::size_t n, std::uint64_t seed)
+{
+    const std::uint64_t k0 = 0xa0761d6478bd642full, k1 = 0xe7037ed1a0b428dbull,
+			k2 = 0x8ebc6af09c88c6e3ull, k3 = 0x589965cc75374cc3ull;
+    const std::uint64_t len = n;
+    const std::uint64_t s1 = mix (seed ^ k1, k2) ^ seed;
+    std::uint64_t h = seed ^ mix (seed ^ k0, k1);
+    for ( ; n > 16; n -= 16, p += 16)
+	h = mix (fold_upper64 (load64 (p)) ^ k1 ^ s1, fold_upper64 (load64 (p+8)) ^ h);
+    std::uint64_t a, b;
+    if (n > 8)
+    {
+	a = fold_upper64 (load64 (p));
+	b = fold_upper64 (load_tail (p+8, n-8));
+    }
+    else
+    {
+	a = fold_upper64 (load_tail (p, n));
+	b = 0;
+    }
+    h = mix (a ^ k1 ^ s1, b ^ h);
+    return mix (h ^ k2, len ^ k3);
+}
+
+} // namespace detail
+
 /// strcmp/strncmp
 /// \brief case-insensitive character strings comparison
 
@@ -86,7 +395,7 @@ struct eqchar
 {
     bool operator () (char lhs, char rhs) const
     {
-	return std::toupper (lhs) == std::toupper (rhs);
+	return detail::toupper (lhs) == detail::toupper (rhs);
     }
 };
 
@@ -99,18 +408,9 @@ struct ltstr
     {
 	if (&lhs != &rhs)
 	{
-	    std::string::const_iterator l = lhs.begin(), l_end = lhs.end();
-	    std::string::const_iterator r = rhs.begin(), r_end = rhs.end();
-	    while (l != l_end && r != r_end)
-	    {
-		int cl = std::toupper (traits_type::to_int_type (*l));
-		int cr = std::toupper (traits_type::to_int_type (*r));
-		if (!traits_type::eq (cl, cr))
-		    return traits_type::lt (cl, cr);
-		++l;
-		++r;
-	    }
-	    return lhs.size() < rhs.size();
+	    std::size_t l_size = lhs.size(), r_size = rhs.size();
+	    int cmp = detail::compare (lhs.data(), rhs.data(), std::min (l_size, r_size));
+	    return cmp? cmp < 0: l_size < r_size;
 	}
 	else
 	    return false;
@@ -122,25 +422,12 @@ struct ltstr
 
 struct eqstr
 {
+    typedef void is_transparent;
+
     bool operator() (const std::string& lhs, const std::string& rhs) const
     {
-	if (lhs.size() == rhs.size())
-	{
-	    std::string::const_iterator l = lhs.begin(), l_end = lhs.end();
-	    std::string::const_iterator r = rhs.begin();
-	    while (l != l_end)
-	    {
-		int cl = std::toupper (traits_type::to_int_type (*l));
-		int cr = std::toupper (traits_type::to_int_type (*r));
-		if (!traits_type::eq (cl, cr))
-		    return false;
-		++l;
-		++r;
-	    }
-	    return true;
-	}
-	else
-	    return false;
+	return lhs.size() == rhs.size()
+	    && detail::mismatch (lhs.data(), rhs.data(), lhs.size()) == lhs.size();
     }
 
     bool operator() (const std::string& lhs, const char* rhs) const
@@ -148,9 +435,7 @@ struct eqstr
 	std::string::const_iterator l = lhs.begin(), l_end = lhs.end();
 	while (l != l_end && *rhs)
 	{
-	    int cl = std::toupper (traits_type::to_int_type (*l));
-	    int cr = std::toupper (traits_type::to_int_type (*rhs));
-	    if (!traits_type::eq (cl, cr))
+	    if (detail::toupper (*l) != detail::toupper (*rhs))
 		return false;
 	    ++l;
 	    ++rhs;
@@ -167,6 +452,14 @@ struct eqstr
     {
         return 0 == strcmp (lhs, rhs);
     }
+
+#if ICASE_STRING_VIEW
+    bool operator() (std::string_view lhs, std::string_view rhs) const
+    {
+	return lhs.size() == rhs.size()
+	    && detail::mismatch (lhs.data(), rhs.data(), lhs.size()) == lhs.size();
+    }
+#endif
 };
 
 // ---------------------------------------------------------------------------
@@ -185,13 +478,34 @@ struct ctype
 	// [22.1.2.4]
 	// The reference returned by use_facet() remains valid at least as long
 	// as any copy of loc exists.
+	, m_ascii (ascii_compatible (m_ctype))
 	{ }
 
     const facet_type& facet () const { return m_ctype; }
 
+    // toupper (C)
+    // Returns: C converted to upper case, bypassing facet for ASCII characters
+    //          when facet maps them just like plain ASCII table does.
+    CharT toupper (CharT c) const
+	{
+	    if (m_ascii && c >= 0 && c < 0x80)
+		return static_cast<CharT> (detail::fold_tables<>::upper[static_cast<int> (c)]);
+	    return m_ctype.toupper (c);
+	}
+
 protected:
+    static bool ascii_compatible (const facet_type& f)
+	{
+	    for (int c = 0; c < 0x80; ++c)
+		if (f.toupper (static_cast<CharT> (c))
+		    != static_cast<CharT> (detail::fold_tables<>::upper[c]))
+		    return false;
+	    return true;
+	}
+
     std::locale		m_loc;
     const facet_type&	m_ctype;
+    bool		m_ascii;
 };
 
 // ---------------------------------------------------------------------------
@@ -220,8 +534,8 @@ struct less : private ctype<typename String::value_type>
 	typename string_type::const_iterator r = rhs.begin(), r_end = rhs.end();
 	while (l != l_end && r != r_end)
 	{
-	    char_type cl = this->facet().toupper (*l);
-	    char_type cr = this->facet().toupper (*r);
+	    char_type cl = this->toupper (*l);
+	    char_type cr = this->toupper (*r);
 	    if (!traits_type::eq (cl, cr))
 		return traits_type::lt (cl, cr);
 	    ++l;
@@ -254,8 +568,8 @@ struct equal_to : private ctype<CharT>
 	    typename String::const_iterator r = rhs.begin();
 	    while (l != l_end)
 	    {
-		char_type cl = this->facet().toupper (*l);
-		char_type cr = this->facet().toupper (*r);
+		char_type cl = this->toupper (*l);
+		char_type cr = this->toupper (*r);
 		if (!traits_type::eq (cl, cr))
 		    return false;
 		++l;
@@ -271,27 +585,41 @@ struct equal_to : private ctype<CharT>
 // ---------------------------------------------------------------------------
 
 /// hash functor
+/// \brief case-insensitive hash consistent with eqstr.
+///
+/// Hash values depend on the seed; to protect tables against hash flooding by
+/// untrusted keys, construct hash with a random seed.
 
 struct hash
 {
-    static const size_t init_value = 5381;
+    typedef void is_transparent;
 
-    size_t operator () (const std::string& s) const
+    hash () : m_seed (0) { }
+    explicit hash (std::uint64_t seed) : m_seed (seed) { }
+
+    std::size_t operator () (const char* s, std::size_t length) const
+    {
+	return static_cast<std::size_t> (detail::hash_bytes (s, length, m_seed));
+    }
+    std::size_t operator () (const std::string& s) const
+    {
+	return operator() (s.data(), s.size());
+    }
+    std::size_t operator () (const char* s) const
     {
-	size_t h = init_value;
-	std::string::const_iterator p = s.begin(), s_end = s.end();
-	for ( ; p != s_end; ++p)
-	    h = 33 * h + std::toupper (traits_type::to_int_type (*p));
-	return h;
+	return operator() (s, std::strlen (s));
     }
-    size_t operator () (const char* s) const
+#if ICASE_STRING_VIEW
+    std::size_t operator () (std::string_view s) const
     {
-	size_t h = init_value;
-	int c;
-        while ((c = traits_type::to_int_type (*s++)))
-            h = 33 * h + std::toupper (c);
-	return h;
+	return operator() (s.data(), s.size());
     }
+#endif
+
+    std::uint64_t seed () const { return m_seed; }
+
+private:
+    std::uint64_t	m_seed;
 };
 
 /// upcase
@@ -300,7 +628,7 @@ struct hash
 struct upcase
 {
     char operator() (char s) const {
-       	return traits_type::to_char_type (std::toupper (traits_type::to_int_type (s)));
+       	return traits_type::to_char_type (detail::toupper (s));
     }
 };
 
@@ -315,7 +643,8 @@ inline Iterator toupper (Iterator first, Iterator last)
 
 inline std::string& toupper (std::string& s)
 {
-    toupper (s.begin(), s.end());
+    if (!s.empty())
+	detail::transform_upper (&s[0], s.size());
     return s;
 }
 
@@ -325,7 +654,7 @@ inline std::string& toupper (std::string& s)
 struct locase
 {
     char operator() (char s) const {
-       	return traits_type::to_char_type (std::tolower (traits_type::to_int_type (s)));
+       	return traits_type::to_char_type (detail::tolower (s));
     }
 };
 
@@ -340,7 +669,8 @@ inline Iterator tolower (Iterator first, Iterator last)
 
 inline std::string& tolower (std::string& s)
 {
-    tolower (s.begin(), s.end());
+    if (!s.empty())
+	detail::transform_lower (&s[0], s.size());
     return s;
 }
 
@@ -0,0 +1,737 @@
+// -*- C++ -*-
+/// \file       icasemap.h
+/// \brief      case insensitive open-addressing hash containers.
+//
+// Copyright (C) 2007 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#ifndef SYS_ICASEMAP_H
+#define SYS_ICASEMAP_H
+
+#include "icase.h"
+#include <string>	// for std::string
+#include <utility>	// for std::pair, std::move, std::forward
+#include <tuple>	// for std::forward_as_tuple
+#include <iterator>	// for std::forward_iterator_tag
+#include <stdexcept>	// for std::out_of_range
+#include <new>		// for placement new
+#include <type_traits>	// for std::aligned_storage, std::enable_if
+#include <cstddef>	// for std::size_t, std::ptrdiff_t
+#include <cstring>	// for std::memset, std::memcpy
+
+namespace icase {
+
+// ---------------------------------------------------------------------------
+// Open-addressing table.
+//
+// Every slot has a one-byte control word: ctrl_empty, ctrl_deleted or, for
+// occupied slots, the low 7 bits of the key hash.  Lookup scans a group of 16
+// control bytes at once (with SSE2, a single compare) and compares keys only
+// for slots whose control byte matches.  The full hash of each key is stored
+// alongside the value, so that growing the table never refolds the keys.
+//
+// Control array holds capacity + group_width - 1 bytes; the first
+// group_width - 1 bytes are mirrored past the end, so that a group may be
+// loaded starting at any slot without wrapping.
+
+namespace detail {
+
+typedef signed char ctrl_t;
+
+const ctrl_t ctrl_empty   = -128;
+const ctrl_t ctrl_deleted = -2;
+const std::size_t group_width = 16;
+
+/// group
+/// \brief group_width control bytes matched at once.
+
+class group
+{
+public:
+#if ICASE_SSE2
+    explicit group (const ctrl_t* ctrl)
+	: m_ctrl (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (ctrl)))
+	{ }
+
+    // match (H2)
+    // Returns: bitmask of slots within the group with control byte H2.
+
+    unsigned match (ctrl_t h2) const
+	{ return _mm_movemask_epi8 (_mm_cmpeq_epi8 (m_ctrl, _mm_set1_epi8 (h2))); }
+
+    // match_free ()
+    // Returns: bitmask of empty or deleted slots within the group.
+
+    unsigned match_free () const
+	{ return _mm_movemask_epi8 (m_ctrl); }
+
+private:
+    __m128i		m_ctrl;
+#else
+    explicit group (const ctrl_t* ctrl) : m_ctrl (ctrl) { }
+
+    unsigned match (ctrl_t h2) const
+    {
+	unsigned mask = 0;
+	for (std::size_t i = 0; i < group_width; ++i)
+	    if (m_ctrl[i] == h2)
+		mask |= 1u << i;
+	return mask;
+    }
+
+    unsigned match_free () const
+    {
+	unsigned mask = 0;
+	for (std::size_t i = 0; i < group_width; ++i)
+	    if (m_ctrl[i] < 0)
+		mask |= 1u << i;
+	return mask;
+    }
+
+private:
+    const ctrl_t*	m_ctrl;
+#endif
+public:
+    unsigned match_empty () const { return match (ctrl_empty); }
+};
+
+/// flat_table<Value, KeyOf>
+/// \brief open-addressing hash table of case-insensitive string keys.
+///
+/// KeyOf::key (const Value&) returns reference to std::string key of the value.
+
+template <class Value, class KeyOf>
+class flat_table
+{
+public:
+    typedef Value		value_type;
+    typedef std::string		key_type;
+    typedef std::size_t		size_type;
+    typedef std::ptrdiff_t	difference_type;
+    typedef icase::hash		hasher;
+    typedef icase::eqstr	key_equal;
+
+    template <class V>
+    class basic_iterator
+    {
+    public:
+	typedef std::forward_iterator_tag	iterator_category;
+	typedef Value				value_type;
+	typedef std::ptrdiff_t			difference_type;
+	typedef V&				reference;
+	typedef V*				pointer;
+
+	basic_iterator () : m_table (0), m_index (0) { }
+	// conversion from iterator to const_iterator
+	template <class U>
+	basic_iterator (const basic_iterator<U>& other,
+			typename std::enable_if<std::is_const<V>::value
+						&& std::is_same<U, Value>::value>::type* = 0)
+	    : m_table (other.m_table), m_index (other.m_index) { }
+
+	reference operator* () const { return m_table->value_at (m_index); }
+	pointer operator-> () const { return &m_table->value_at (m_index); }
+
+	basic_iterator& operator++ ()
+	    { m_index = m_table->next_full (m_index + 1); return *this; }
+	basic_iterator operator++ (int)
+	    { basic_iterator tmp (*this); ++*this; return tmp; }
+
+	template <class U>
+	bool operator== (const basic_iterator<U>& rhs) const
+	    { return m_index == rhs.m_index; }
+	template <class U>
+	bool operator!= (const basic_iterator<U>& rhs) const
+	    { return m_index != rhs.m_index; }
+
+    private:
+	basic_iterator (const flat_table* table, size_type index)
+	    : m_table (table), m_index (index) { }
+
+	const flat_table*	m_table;
+	size_type		m_index;
+
+	template <class U> friend class basic_iterator;
+	friend class flat_table;
+    };
+
+    typedef basic_iterator<Value>	iterator;
+    typedef basic_iterator<const Value>	const_iterator;
+
+    static const size_type npos = static_cast<size_type> (-1);
+
+    explicit flat_table (size_type n = 0, const hasher& hf = hasher ())
+	: m_ctrl (0), m_slots (0), m_capacity (0), m_size (0), m_deleted (0)
+	, m_hash (hf)
+    {
+	if (n)
+	    reserve (n);
+    }
+    flat_table (const flat_table& other);
+    flat_table (flat_table&& other)
+	: m_ctrl (other.m_ctrl), m_slots (other.m_slots)
+	, m_capacity (other.m_capacity), m_size (other.m_size)
+	, m_deleted (other.m_deleted), m_hash (other.m_hash)
+    {
+	other.m_ctrl = 0;
+	other.m_slots = 0;
+	other.m_capacity = other.m_size = other.m_deleted = 0;
+    }
+    ~flat_table () { destroy(); }
+
+    flat_table& operator= (flat_table other)
+    {
+	swap (other);
+	return *this;
+    }
+
+    iterator begin () { return iterator (this, next_full (0)); }
+    iterator end () { return iterator (this, m_capacity); }
+    const_iterator begin () const { return const_iterator (this, next_full (0)); }
+    const_iterator end () const { return const_iterator (this, m_capacity); }
+    const_iterator cbegin () const { return begin(); }
+    const_iterator cend () const { return end(); }
+
+    bool empty () const { return 0 == m_size; }
+    size_type size () const { return m_size; }
+    size_type bucket_count () const { return m_capacity; }
+    hasher hash_function () const { return m_hash; }
+    key_equal key_eq () const { return key_equal(); }
+
+    // clear ()
+    // Effects: destroys all values, retaining allocated storage.
+
+    void clear ();
+
+    // reserve (N)
+    // Effects: makes room for N values without further rehashing.
+
+    void reserve (size_type n);
+
+    void swap (flat_table& other);
+
+    iterator find (const std::string& key)
+	{ return make_iterator (find_index (key.data(), key.size())); }
+    const_iterator find (const std::string& key) const
+	{ return make_iterator (find_index (key.data(), key.size())); }
+    iterator find (const char* key)
+	{ return make_iterator (find_index (key, std::strlen (key))); }
+    const_iterator find (const char* key) const
+	{ return make_iterator (find_index (key, std::strlen (key))); }
+#if ICASE_STRING_VIEW
+    iterator find (std::string_view key)
+	{ return make_iterator (find_index (key.data(), key.size())); }
+    const_iterator find (std::string_view key) const
+	{ return make_iterator (find_index (key.data(), key.size())); }
+#endif
+
+    size_type count (const std::string& key) const
+	{ return find_index (key.data(), key.size()) != npos; }
+    size_type count (const char* key) const
+	{ return find_index (key, std::strlen (key)) != npos; }
+#if ICASE_STRING_VIEW
+    size_type count (std::string_view key) const
+	{ return find_index (key.data(), key.size()) != npos; }
+#endif
+
+    size_type erase (const std::string& key)
+	{ return erase_index (find_index (key.data(), key.size())); }
+    size_type erase (const char* key)
+	{ return erase_index (find_index (key, std::strlen (key))); }
+#if ICASE_STRING_VIEW
+    size_type erase (std::string_view key)
+	{ return erase_index (find_index (key.data(), key.size())); }
+#endif
+
+    // erase (POS)
+    // Effects: removes value at POS.
+    // Returns: iterator following the removed value.
+
+    iterator erase (const_iterator pos)
+    {
+	erase_index (pos.m_index);
+	return iterator (this, next_full (pos.m_index + 1));
+    }
+
+protected:
+    struct slot
+    {
+	std::size_t	hash;
+	typename std::aligned_storage<sizeof(Value), alignof(Value)>::type
+			storage;
+
+	Value& value () { return *reinterpret_cast<Value*> (&storage); }
+    };
+
+    // find_index (KEY, LENGTH)
+    // Returns: index of the slot holding KEY, or npos if there's none.
+
+    size_type find_index (const char* key, size_type length) const
+    {
+	if (!m_size)
+	    return npos;
+	return find_index (key, length, m_hash (key, length));
+    }
+
+    size_type find_index (const char* key, size_type length, std::size_t hash) const;
+
+    // prepare_insert (KEY, LENGTH, HASH)
+    // Effects: looks up KEY and, if it's not found, grows the table if necessary.
+    // Returns: pair of slot index and flag which is true if KEY is absent and
+    //          the slot is free.
+
+    std::pair<size_type, bool>
+    prepare_insert (const char* key, size_type length, std::size_t hash);
+
+    // emplace_at (INDEX, HASH, ARGS)
+    // Effects: constructs value from ARGS in the free slot INDEX.
+
+    template <class... Args>
+    iterator emplace_at (size_type index, std::size_t hash, Args&&... args)
+    {
+	slot& s = m_slots[index];
+	::new (&s.storage) Value (std::forward<Args> (args)...);
+	s.hash = hash;
+	if (m_ctrl[index] == ctrl_deleted)
+	    --m_deleted;
+	set_ctrl (index, h2 (hash));
+	++m_size;
+	return iterator (this, index);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool>
+    emplace_key (const char* key, size_type length, Args&&... args)
+    {
+	std::size_t hash = m_hash (key, length);
+	std::pair<size_type, bool> pos = prepare_insert (key, length, hash);
+	if (!pos.second)
+	    return std::make_pair (iterator (this, pos.first), false);
+	return std::make_pair (emplace_at (pos.first, hash, std::forward<Args> (args)...), true);
+    }
+
+    Value& value_at (size_type index) const
+	{ return m_slots[index].value(); }
+
+    iterator make_iterator (size_type index)
+	{ return iterator (this, index != npos? index: m_capacity); }
+    const_iterator make_iterator (size_type index) const
+	{ return const_iterator (this, index != npos? index: m_capacity); }
+
+private:
+    static std::size_t h1 (std::size_t hash) { return hash >> 7; }
+    static ctrl_t h2 (std::size_t hash) { return static_cast<ctrl_t> (hash & 0x7f); }
+
+    // growth_limit ()
+    // Returns: maximum number of used (full or deleted) slots, 7/8 of capacity.
+
+    size_type growth_limit () const { return m_capacity - m_capacity / 8; }
+
+    void set_ctrl (size_type index, ctrl_t c)
+    {
+	m_ctrl[index] = c;
+	if (index < group_width - 1)
+	    m_ctrl[m_capacity + index] = c;
+    }
+
+    size_type next_full (size_type index) const
+    {
+	while (index < m_capacity && m_ctrl[index] < 0)
+	    ++index;
+	return index;
+    }
+
+    // find_free (HASH)
+    // Returns: index of the first empty or deleted slot in the probe
+    //          sequence of HASH.
+
+    size_type find_free (std::size_t hash) const;
+
+    size_type erase_index (size_type index);
+
+    // rehash (NEW_CAPACITY)
+    // Effects: moves values into the table of NEW_CAPACITY slots, using stored
+    //          hashes; drops deleted markers.
+
+    void rehash (size_type new_capacity);
+
+    void destroy ();
+
+    ctrl_t*		m_ctrl;
+    slot*		m_slots;
+    size_type		m_capacity;
+    size_type		m_size;
+    size_type		m_deleted;
+    hasher		m_hash;
+};
+
+template <class Value, class KeyOf>
+flat_table<Value, KeyOf>::
+flat_table (const flat_table& other)
+    : m_ctrl (0), m_slots (0), m_capacity (0), m_size (0), m_deleted (0)
+    , m_hash (other.m_hash)
+{
+    reserve (other.m_size);
+    try
+    {
+	for (size_type i = other.next_full (0); i < other.m_capacity; i = other.next_full (i+1))
+	{
+	    std::size_t hash = other.m_slots[i].hash;
+	    emplace_at (find_free (hash), hash, other.value_at (i));
+	}
+    }
+    catch (...)
+    {
+	destroy();
+	throw;
+    }
+}
+
+template <class Value, class KeyOf>
+typename flat_table<Value, KeyOf>::size_type flat_table<Value, KeyOf>::
+find_index (const char* key, size_type length, std::size_t hash) const
+{
+    const size_type mask = m_capacity - 1;
+    const ctrl_t tag = h2 (hash);
+    size_type pos = h1 (hash) & mask;
+    for (size_type step = group_width; ; step += group_width)
+    {
+	group g (m_ctrl + pos);
+	for (unsigned bits = g.match (tag); bits; bits &= bits - 1)
+	{
+	    size_type index = (pos + first_bit (bits)) & mask;
+	    const slot& s = m_slots[index];
+	    if (s.hash == hash)
+	    {
+		const std::string& k = KeyOf::key (value_at (index));
+		if (k.size() == length && mismatch (k.data(), key, length) == length)
+		    return index;
+	    }
+	}
+	if (g.match_empty())
+	    return npos;
+	pos = (pos + step) & mask;
+    }
+}
+
+template <class Value, class KeyOf>
+typename flat_table<Value, KeyOf>::size_type flat_table<Value, KeyOf>::
+find_free (std::size_t hash) const
+{
+    const size_type mask = m_capacity - 1;
+    size_type pos = h1 (hash) & mask;
+    for (size_type step = group_width; ; step += group_width)
+    {
+	if (unsigned bits = group (m_ctrl + pos).match_free())
+	    return (pos + first_bit (bits)) & mask;
+	pos = (pos + step) & mask;
+    }
+}
+
+template <class Value, class KeyOf>
+std::pair<typename flat_table<Value, KeyOf>::size_type, bool> flat_table<Value, KeyOf>::
+prepare_insert (const char* key, size_type length, std::size_t hash)
+{
+    if (m_size)
+    {
+	size_type index = find_index (key, length, hash);
+	if (index != npos)
+	    return std::make_pair (index, false);
+    }
+    if (m_size + m_deleted >= growth_limit())
+    {
+	// reclaim deleted slots if they take a sizeable part of the table,
+	// otherwise grow it
+	if (m_deleted > m_size / 2 && m_size + 1 < growth_limit())
+	    rehash (m_capacity);
+	else
+	    rehash (m_capacity? m_capacity * 2: group_width);
+    }
+    return std::make_pair (find_free (hash), true);
+}
+
+template <class Value, class KeyOf>
+typename flat_table<Value, KeyOf>::size_type flat_table<Value, KeyOf>::
+erase_index (size_type index)
+{
+    if (index == npos || index >= m_capacity)
+	return 0;
+    m_slots[index].value().~Value();
+    // slot may become empty again only if no probe sequence ever passed over
+    // it, i.e. if every group covering it has an empty slot.
+    const size_type mask = m_capacity - 1;
+    unsigned after = group (m_ctrl + index).match_empty();
+    unsigned before = group (m_ctrl + ((index - group_width) & mask)).match_empty();
+    size_type span = 0;
+    if (after && before)
+    {
+	span = first_bit (after);
+	for (unsigned bit = 1u << (group_width - 1); !(before & bit); bit >>= 1)
+	    ++span;
+    }
+    if (after && before && span < group_width)
+	set_ctrl (index, ctrl_empty);
+    else
+    {
+	set_ctrl (index, ctrl_deleted);
+	++m_deleted;
+    }
+    --m_size;
+    return 1;
+}
+
+template <class Value, class KeyOf>
+void flat_table<Value, KeyOf>::
+rehash (size_type new_capacity)
+{
+    ctrl_t* old_ctrl = m_ctrl;
+    slot* old_slots = m_slots;
+    size_type old_capacity = m_capacity;
+
+    m_slots = static_cast<slot*> (::operator new (new_capacity * sizeof(slot)));
+    try
+    {
+	m_ctrl = new ctrl_t[new_capacity + group_width - 1];
+    }
+    catch (...)
+    {
+	::operator delete (m_slots);
+	m_slots = old_slots;
+	throw;
+    }
+    std::memset (m_ctrl, ctrl_empty, new_capacity + group_width - 1);
+    m_capacity = new_capacity;
+    m_deleted = 0;
+
+    for (size_type i = 0; i < old_capacity; ++i)
+    {
+	if (old_ctrl[i] < 0)
+	    continue;
+	slot& src = old_slots[i];
+	size_type index = find_free (src.hash);
+	slot& dst = m_slots[index];
+	::new (&dst.storage) Value (std::move (src.value()));
+	src.value().~Value();
+	dst.hash = src.hash;
+	set_ctrl (index, h2 (src.hash));
+    }
+    delete[] old_ctrl;
+    ::operator delete (old_slots);
+}
+
+template <class Value, class KeyOf>
+void flat_table<Value, KeyOf>::
+reserve (size_type n)
+{
+    size_type capacity = m_capacity? m_capacity: group_width;
+    while (capacity - capacity / 8 < n)
+	capacity *= 2;
+    if (capacity != m_capacity)
+	rehash (capacity);
+}
+
+template <class Value, class KeyOf>
+void flat_table<Value, KeyOf>::
+clear ()
+{
+    if (!m_capacity)
+	return;
+    for (size_type i = next_full (0); i < m_capacity; i = next_full (i+1))
+	m_slots[i].value().~Value();
+    std::memset (m_ctrl, ctrl_empty, m_capacity + group_width - 1);
+    m_size = m_deleted = 0;
+}
+
+template <class Value, class KeyOf>
+void flat_table<Value, KeyOf>::
+swap (flat_table& other)
+{
+    using std::swap;
+    swap (m_ctrl, other.m_ctrl);
+    swap (m_slots, other.m_slots);
+    swap (m_capacity, other.m_capacity);
+    swap (m_size, other.m_size);
+    swap (m_deleted, other.m_deleted);
+    swap (m_hash, other.m_hash);
+}
+
+template <class Value, class KeyOf>
+void flat_table<Value, KeyOf>::
+destroy ()
+{
+    clear();
+    delete[] m_ctrl;
+    ::operator delete (m_slots);
+    m_ctrl = 0;
+    m_slots = 0;
+    m_capacity = 0;
+}
+
+struct key_of_pair
+{
+    template <class Pair>
+    static const std::string& key (const Pair& p) { return p.first; }
+};
+
+struct key_of_string
+{
+    static const std::string& key (const std::string& s) { return s; }
+};
+
+} // namespace detail
+
+// ---------------------------------------------------------------------------
+
+/// flat_map<T>
+/// \brief hash map from case-insensitive string keys to values of type T.
+///
+/// Unlike std::unordered_map, values are stored in a single open-addressing
+/// array; insertion and rehash invalidate iterators and references.  Keys are
+/// stored as the first member of std::pair<std::string, T> and must not be
+/// modified through iterators.
+
+template <typename T>
+class flat_map : public detail::flat_table<std::pair<std::string, T>, detail::key_of_pair>
+{
+    typedef detail::flat_table<std::pair<std::string, T>, detail::key_of_pair> base_type;
+
+public:
+    typedef std::string				key_type;
+    typedef T					mapped_type;
+    typedef typename base_type::value_type	value_type;
+    typedef typename base_type::size_type	size_type;
+    typedef typename base_type::hasher		hasher;
+    typedef typename base_type::iterator	iterator;
+    typedef typename base_type::const_iterator	const_iterator;
+
+    explicit flat_map (size_type n = 0, const hasher& hf = hasher ())
+	: base_type (n, hf) { }
+
+    std::pair<iterator, bool> insert (const value_type& value)
+	{ return this->emplace_key (value.first.data(), value.first.size(), value); }
+    std::pair<iterator, bool> insert (value_type&& value)
+    {
+	const std::string& key = value.first;
+	return this->emplace_key (key.data(), key.size(), std::move (value));
+    }
+
+    // try_emplace (KEY, ARGS)
+    // Effects: if KEY isn't in the map, inserts value constructed from KEY
+    //          and ARGS.
+    // Returns: pair of iterator pointing to KEY and flag indicating whether
+    //          the value was inserted.
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace (const std::string& key, Args&&... args)
+    {
+	return this->emplace_key (key.data(), key.size(), std::piecewise_construct,
+				  std::forward_as_tuple (key),
+				  std::forward_as_tuple (std::forward<Args> (args)...));
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace (std::string&& key, Args&&... args)
+    {
+	// key is moved only after the slot is found
+	std::size_t hash = this->hash_function() (key);
+	auto pos = this->prepare_insert (key.data(), key.size(), hash);
+	if (!pos.second)
+	    return std::make_pair (this->make_iterator (pos.first), false);
+	return std::make_pair (this->emplace_at (pos.first, hash, std::piecewise_construct,
+						 std::forward_as_tuple (std::move (key)),
+						 std::forward_as_tuple (std::forward<Args> (args)...)),
+			       true);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace (const char* key, Args&&... args)
+    {
+	return this->emplace_key (key, std::strlen (key), std::piecewise_construct,
+				  std::forward_as_tuple (key),
+				  std::forward_as_tuple (std::forward<Args> (args)...));
+    }
+
+    T& operator[] (const std::string& key) { return try_emplace (key).first->second; }
+    T& operator[] (std::string&& key) { return try_emplace (std::move (key)).first->second; }
+    T& operator[] (const char* key) { return try_emplace (key).first->second; }
+
+    // at (KEY)
+    // Returns: reference to value mapped to KEY.
+    // Throws: std::out_of_range if KEY isn't in the map.
+
+    template <class Key>
+    T& at (const Key& key)
+    {
+	iterator it = this->find (key);
+	if (it == this->end())
+	    throw std::out_of_range ("icase::flat_map::at");
+	return it->second;
+    }
+    template <class Key>
+    const T& at (const Key& key) const
+    {
+	const_iterator it = this->find (key);
+	if (it == this->end())
+	    throw std::out_of_range ("icase::flat_map::at");
+	return it->second;
+    }
+};
+
+/// flat_set
+/// \brief hash set of case-insensitive strings.
+///
+/// Same as with flat_map, strings must not be modified through iterators.
+
+class flat_set : public detail::flat_table<std::string, detail::key_of_string>
+{
+    typedef detail::flat_table<std::string, detail::key_of_string> base_type;
+
+public:
+    typedef std::string		key_type;
+
+    explicit flat_set (size_type n = 0, const hasher& hf = hasher ())
+	: base_type (n, hf) { }
+
+    std::pair<iterator, bool> insert (const std::string& key)
+	{ return emplace_key (key.data(), key.size(), key); }
+    std::pair<iterator, bool> insert (std::string&& key)
+    {
+	std::size_t hash = hash_function() (key);
+	std::pair<size_type, bool> pos = prepare_insert (key.data(), key.size(), hash);
+	if (!pos.second)
+	    return std::make_pair (make_iterator (pos.first), false);
+	return std::make_pair (emplace_at (pos.first, hash, std::move (key)), true);
+    }
+    std::pair<iterator, bool> insert (const char* key)
+	{ return emplace_key (key, std::strlen (key), key); }
+#if ICASE_STRING_VIEW
+    std::pair<iterator, bool> insert (std::string_view key)
+	{ return emplace_key (key.data(), key.size(), key); }
+#endif
+};
+
+template <class Value, class KeyOf>
+inline void swap (detail::flat_table<Value, KeyOf>& lhs, detail::flat_table<Value, KeyOf>& rhs)
+{
+    lhs.swap (rhs);
+}
+
+} // namespace icase
+
+#endif /* SYS_ICASEMAP_H */
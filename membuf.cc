@@ -25,6 +25,18 @@
 //
 
 #include "membuf.hpp"
+#include <cstring>	// for std::memcpy
+#include "timer.hpp"	// for SYSPP_TIMED_SCOPE
+#include "sysfs.h"	// for sys::file::extent_reader
+
+#ifdef _WIN32
+#include "sysio.h"
+#else
+#include <sys/uio.h>	// for writev
+#include <climits>	// for IOV_MAX
+#include <cerrno>
+#include <fcntl.h>	// for fcntl
+#endif
 
 namespace sys {
 
@@ -46,6 +58,7 @@ greserve (size_type sz)
     size_type result = egptr() - gptr();
     if (sz > result)
     {
+	SYSPP_TIMED_SCOPE ("sys::mapped_buf::greserve");
 	m_offset += gptr() - eback();
 	m_remap (sz);
 	result = egptr() - gptr();
@@ -59,6 +72,7 @@ preserve (size_type sz)
     size_type result = epptr() - pptr();
     if (sz > result)
     {
+	SYSPP_TIMED_SCOPE ("sys::mapped_buf::preserve");
 	m_offset += pptr() - pbase();
 	m_remap (sz);
 	result = epptr() - pptr();
@@ -221,4 +235,314 @@ xsputn (const char_type* buf, std::streamsize size)
     return size;
 }
 
+// ---------------------------------------------------------------------------
+// transfer
+
+namespace {
+
+// data_ahead (FILE)
+// Returns: number of bytes between current position of FILE and its end,
+//          past which holes could be reproduced by advancing the position;
+//          -1 if FILE is not seekable or writes to it are appended.
+
+mapping::off_type data_ahead (raw_handle file)
+{
+    result<std::streamoff> pos = try_seek_file (file, 0, std::ios::cur);
+    if (!pos)
+	return -1;
+#ifndef _WIN32
+    int flags = ::fcntl (file, F_GETFL);
+    if (flags == -1 || (flags & O_APPEND))
+	return -1;
+#endif
+    result<file::size_type> size = file::try_get_size (file);
+    if (!size)
+	return -1;
+    return *size > file::size_type (*pos) ? mapping::off_type (*size - *pos) : 0;
+}
+
+// write_all (FILE, BUF, SIZE)
+
+result<void> write_all (raw_handle file, const char* buf, size_t size)
+{
+    for (size_t done = 0; done < size; )
+    {
+	result<size_t> written = try_write_file (file, buf + done, size - done);
+	if (!written)
+	    return error_code (written.error());
+	if (!*written)
+	    return error_code (EIO);
+	done += *written;
+    }
+    return result<void>();
+}
+
+// write_zeros (FILE, SIZE)
+
+result<void> write_zeros (raw_handle file, mapping::off_type size)
+{
+    static const char zeros[65536] = { 0 };
+    while (size > 0)
+    {
+	size_t chunk = static_cast<size_t> (std::min<mapping::off_type> (size, sizeof(zeros)));
+	result<void> rc = write_all (file, zeros, chunk);
+	if (!rc)
+	    return rc;
+	size -= chunk;
+    }
+    return result<void>();
+}
+
+} // anonymous namespace
+
+result<mapped_buf::size_type> mapped_buf::
+try_write_to (raw_handle file)
+{
+    if (!is_open())
+	return error_code (mapping::detail::invalid_map_error);
+
+    SYSPP_TIMED_SCOPE ("sys::mapped_buf::write_to");
+    // data is written through the views of this size
+    const size_type chunk_size = 1 << 22;
+    const mapping::off_type start = goffset(), map_end = map_size();
+    const bool private_map = m_view.copy_on_write();
+    // holes are skipped over only where FILE has no data to overwrite
+    mapping::off_type ahead = data_ahead (file);
+    file::extent_reader extents (m_view.file_handle(), start);
+    mapping::off_type pos = start;
+    bool trailing_hole = false;
+    while (pos < map_end)
+    {
+	file::extent ext (pos, map_end - pos, false);
+	if (!private_map)
+	{
+	    result<bool> more = extents.try_next (ext);
+	    if (!more)
+		return error_code (more.error());
+	    if (!*more)
+		break;
+	}
+	mapping::off_type end = std::min<mapping::off_type> (ext.end(), map_end);
+	const mapping::off_type from = pos;
+	mapping::off_type skipped = 0;
+	if (ext.hole)
+	{
+	    // source pages are not touched either way
+	    mapping::off_type zeros = end - pos;
+	    if (ahead >= 0 && ahead < zeros)
+		zeros = ahead;
+	    result<void> rc = write_zeros (file, zeros);
+	    if (!rc)
+		return error_code (rc.error());
+	    skipped = end - pos - zeros;
+	    if (skipped)
+	    {
+		result<std::streamoff> sk = try_seek_file (file, skipped, std::ios::cur);
+		if (!sk)
+		    return error_code (sk.error());
+	    }
+	    pos = end;
+	}
+	while (pos < end)
+	{
+	    view_type chunk;
+	    chunk.bind (m_view);
+	    result<void> rc = chunk.try_remap (pos, std::min<mapping::off_type> (end - pos, chunk_size));
+	    if (!rc)
+		return error_code (rc.error());
+	    rc = write_all (file, chunk.data(), chunk.size());
+	    if (!rc)
+		return error_code (rc.error());
+	    pos += chunk.size();
+	}
+	if (ahead > 0)
+	    ahead = ahead > end - from ? ahead - (end - from) : 0;
+	trailing_hole = skipped != 0;
+    }
+    if (trailing_hole)
+    {
+	// seeking alone does not extend the file
+	result<std::streamoff> rc = try_seek_file (file, -1, std::ios::cur);
+	if (!rc)
+	    return error_code (rc.error());
+	result<void> written = write_all (file, "", 1);
+	if (!written)
+	    return error_code (written.error());
+    }
+    m_seek (pos, std::ios::beg, std::ios::in|std::ios::out);
+    return size_type (pos - start);
+}
+
+// ---------------------------------------------------------------------------
+// segment_pool
+
+segment_pool::
+~segment_pool ()
+{
+    for (std::vector<char*>::iterator it = m_free.begin(); it != m_free.end(); ++it)
+	delete[] *it;
+}
+
+char* segment_pool::
+allocate ()
+{
+    if (m_free.empty())
+	return new char[m_segment_size];
+    char* segment = m_free.back();
+    m_free.pop_back();
+    return segment;
+}
+
+void segment_pool::
+deallocate (char* segment)
+{
+    if (m_free.size() < m_max_free)
+	m_free.push_back (segment);
+    else
+	delete[] segment;
+}
+
+// ---------------------------------------------------------------------------
+// segmented_buf
+
+void segmented_buf::
+m_new_segment ()
+{
+    if (!m_spans.empty())
+    {
+	m_spans.back().size = pptr() - pbase();
+	m_size += m_spans.back().size;
+    }
+    span seg = { m_pool.allocate(), 0 };
+    try
+    {
+	m_spans.push_back (seg);
+    }
+    catch (...)
+    {
+	m_pool.deallocate (const_cast<char_type*> (seg.data));
+	throw;
+    }
+    char_type* data = const_cast<char_type*> (seg.data);
+    setp (data, data + m_pool.segment_size());
+}
+
+const segmented_buf::span_list& segmented_buf::
+spans ()
+{
+    if (!m_spans.empty())
+	m_spans.back().size = pptr() - pbase();
+    return m_spans;
+}
+
+void segmented_buf::
+clear ()
+{
+    for (span_list::iterator it = m_spans.begin(); it != m_spans.end(); ++it)
+	m_pool.deallocate (const_cast<char_type*> (it->data));
+    m_spans.clear();
+    m_size = 0;
+    setp (0, 0);
+}
+
+segmented_buf::int_type segmented_buf::
+overflow (int_type c)
+{
+    if (traits_type::eq_int_type (c, traits_type::eof()))
+	return traits_type::not_eof (c);
+
+    if (pptr() == epptr())
+	m_new_segment();
+    *pptr() = traits_type::to_char_type (c);
+    pbump (1);
+
+    return (c);
+}
+
+std::streamsize segmented_buf::
+xsputn (const char_type* buf, std::streamsize size)
+{
+    std::streamsize written = 0;
+    while (written < size)
+    {
+	if (pptr() == epptr())
+	    m_new_segment();
+	size_type chunk = std::min<size_type> (size - written, epptr() - pptr());
+	std::memcpy (pptr(), buf + written, chunk);
+	pbump (static_cast<int> (chunk));
+	written += chunk;
+    }
+    return written;
+}
+
+segmented_buf::pos_type segmented_buf::
+seekoff (off_type off, std::ios::seekdir way, std::ios::openmode mode)
+{
+    // only position reporting is supported
+    if (off == 0 && way == std::ios::cur && (mode & std::ios::out))
+	return pos_type (off_type (size()));
+    return pos_type (off_type (-1));
+}
+
+result<segmented_buf::size_type> segmented_buf::
+try_write_to (raw_handle file)
+{
+    const span_list& list = spans();
+    size_type total = 0;
+#ifdef _WIN32
+    for (span_list::const_iterator it = list.begin(); it != list.end(); ++it)
+    {
+	result<void> rc = write_all (file, it->data, it->size);
+	if (!rc)
+	    return error_code (rc.error());
+	total += it->size;
+    }
+#else
+#ifdef IOV_MAX
+    const int batch_size = IOV_MAX < 256 ? IOV_MAX : 256;
+#else
+    const int batch_size = 16;
+#endif
+    size_type index = 0, offset = 0;	// first unwritten byte
+    while (index < list.size())
+    {
+	struct iovec iov[batch_size];
+	int count = 0;
+	for (size_type i = index; i < list.size() && count < batch_size; ++i)
+	{
+	    size_type skip = i == index ? offset : 0;
+	    if (list[i].size == skip)
+		continue;
+	    iov[count].iov_base = const_cast<char_type*> (list[i].data + skip);
+	    iov[count].iov_len = list[i].size - skip;
+	    ++count;
+	}
+	if (!count)
+	    break;
+	ssize_t written = ::writev (file, iov, count);
+	if (written < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    return error_code::last();
+	}
+	// no progress would be made
+	if (!written)
+	    return error_code (EIO);
+	total += written;
+	// advance past the written bytes
+	size_type left = written;
+	while (index < list.size() && left >= list[index].size - offset)
+	{
+	    left -= list[index].size - offset;
+	    offset = 0;
+	    ++index;
+	}
+	offset += left;
+    }
+#endif
+    clear();
+    return total;
+}
+
 } // namespace sys
@@ -29,15 +29,26 @@
 
 #include <ios>
 #include <streambuf>
+#include <memory>	// for std::allocator, std::unique_ptr
+#include <algorithm>	// for std::max
+#include <type_traits>	// for std::is_same, std::is_scalar
+#include <cstdlib>	// for std::malloc, std::realloc, std::free
+#include <new>		// for std::bad_alloc
+#include <vector>
 #include "sysmemmap.h"
+#include "syshandle.h"
+#include "syserror.h"
 
 namespace sys {
 
 template <typename CharT, typename Traits = std::char_traits<CharT> >
 class basic_memory_buf;
 
+struct geometric_growth;
+
 template <typename CharT, typename Traits = std::char_traits<CharT>,
-	  typename Alloc = std::allocator<CharT> >
+	  typename Alloc = std::allocator<CharT>,
+	  typename Growth = geometric_growth>
 class dynamic_memory_buf;
 
 typedef basic_memory_buf<char>	    memory_buf;
@@ -128,12 +139,54 @@ protected: // data
     std::ios::openmode		m_mode;
 };
 
+// ---------------------------------------------------------------------------
+// Growth policies of dynamic_memory_buf.
+//
+// Policy is a function object that takes current capacity and required size
+// of the buffer, both in bytes, and returns new capacity in bytes, which is
+// expected to be no less than the required size.
+
+/// \class geometric_growth
+/// \brief grows buffer by half of its capacity, but no less than by GROW_SIZE
+///        bytes.
+
+struct geometric_growth
+{
+    enum { GROW_SIZE = 1024 };
+
+    size_t operator() (size_t capacity, size_t required) const
+	{
+	    size_t grown = capacity + std::max<size_t> (capacity / 2, GROW_SIZE);
+	    return std::max (grown, required);
+	}
+};
+
+/// \class page_growth
+/// \brief geometric growth with capacity rounded up to the page boundary,
+///        intended for buffers of several megabytes, which are allocated by
+///        pages anyway.
+
+struct page_growth
+{
+    size_t operator() (size_t capacity, size_t required) const
+	{
+	    size_t size = geometric_growth() (capacity, required);
+	    size_t mask = mapping::page_size() - 1;
+	    return (size + mask) & ~mask;
+	}
+};
+
 // ---------------------------------------------------------------------------
 /// \class dynamic_memory_buf
 /// \brief Stream buffer on top of the character sequence
 //         with dynamic memory management.
+///
+/// Buffer capacity grows as directed by Growth policy.  With the default
+/// allocator, scalar characters are kept in a malloc'ed block that is grown
+/// by realloc, which may extend the block in place or remap its pages
+/// instead of copying the contents.
 
-template <typename CharT, typename Traits, typename Alloc>
+template <typename CharT, typename Traits, typename Alloc, typename Growth>
 class dynamic_memory_buf : public basic_memory_buf<CharT, Traits>
 		         , private Alloc
 {
@@ -143,15 +196,44 @@ public: // types
     typedef CharT				char_type;
     typedef Traits				traits_type;
     typedef Alloc				allocator_type;
+    typedef Growth				growth_policy;
     typedef typename traits_type::int_type 	int_type;
     typedef typename traits_type::pos_type 	pos_type;
     typedef typename traits_type::off_type	off_type;
     typedef typename base_type::size_type	size_type;
 
+    SYSPP_static_constexpr bool use_realloc =
+	std::is_same<Alloc, std::allocator<CharT> >::value && std::is_scalar<CharT>::value;
+
+    /// \class buffer_deleter
+    /// \brief frees buffer handed off by release().
+    class buffer_deleter : private Alloc
+    {
+    public:
+	explicit buffer_deleter (const Alloc& alloc = Alloc(), size_type capacity = 0)
+	    : Alloc (alloc), m_capacity (capacity) { }
+
+	void operator() (char_type* p)
+	    {
+		if (use_realloc)
+		    std::free (p);
+		else
+		    this->deallocate (p, m_capacity);
+	    }
+
+	size_type capacity () const { return m_capacity; }
+
+    private:
+	size_type	m_capacity;
+    };
+
+    typedef std::unique_ptr<char_type[], buffer_deleter> buffer_ptr;
+
 public: // methods
 
-    explicit dynamic_memory_buf (std::ios::openmode mode = 0)
-       	: base_type (mode), m_allocated (false)
+    explicit dynamic_memory_buf (std::ios::openmode mode = std::ios::openmode(),
+				 const growth_policy& growth = growth_policy())
+       	: base_type (mode), m_allocated (false), m_growth (growth)
       	{}
     dynamic_memory_buf (const char_type* in, size_type sz, std::ios::openmode mode)
 	: base_type (mode), m_allocated (false)
@@ -161,9 +243,32 @@ public: // methods
 	: base_type (mode), m_allocated (false)
 	{ this->setbuf (const_cast<char_type*> (ary), N); }
 
+    ~dynamic_memory_buf () { m_free(); }
+
     allocator_type get_allocator () const
        	{ return static_cast<allocator_type> (*this); }
 
+    /// capacity()
+    /// \return size of the underlying sequence.
+    size_type capacity () const { return this->epptr() - this->eback(); }
+
+    /// reserve (SIZE)
+    /// \brief makes underlying sequence large enough to hold SIZE characters
+    ///        without reallocation.
+    void reserve (size_type sz)
+	{
+	    if (sz > capacity())
+		m_reallocate (sz);
+	}
+
+    /// release()
+    /// \brief hands off underlying sequence to the caller and leaves the buffer
+    ///        empty.  Written portion of the sequence is psize() characters
+    ///        long, as returned before the call.  Sequence supplied by user is
+    ///        copied into allocated storage first.
+    /// \return pointer owning the sequence, or null pointer if there is none.
+    buffer_ptr release ();
+
 protected: // virtual methods
 
     int_type overflow (int_type c);
@@ -171,24 +276,48 @@ protected: // virtual methods
 
     std::streambuf* setbuf (char_type* s, std::streamsize n)
 	{
-	    if (m_allocated)
-	    {
-		this->deallocate (this->eback(), this->epptr() - this->eback());
-		m_allocated = false;
-	    }
+	    m_free();
 	    return base_type::setbuf (s, n);
        	}
 
 private: // methods
 
-    // m_grow (NEW_SIZE)
-    void m_grow (size_type new_size);
+    dynamic_memory_buf (const dynamic_memory_buf&);		// not defined
+    dynamic_memory_buf& operator= (const dynamic_memory_buf&);	// not defined
 
-protected: // data
+    // m_grow (REQUIRED)
+    // Effects: enlarges underlying sequence to at least REQUIRED characters, as
+    //          directed by growth policy.
+    void m_grow (size_type required);
 
-    enum { GROW_SIZE = 1024 };
+    // m_reallocate (NEW_SIZE)
+    // Effects: moves contents into the sequence of NEW_SIZE characters,
+    //          retaining get/put positions.
+    void m_reallocate (size_type new_size);
+
+    char_type* m_allocate (size_type n)
+	{
+	    if (!use_realloc)
+		return this->allocate (n);
+	    void* p = std::malloc (n * sizeof(char_type));
+	    if (!p)
+		throw std::bad_alloc();
+	    return static_cast<char_type*> (p);
+	}
+
+    void m_free ()
+	{
+	    if (m_allocated)
+	    {
+		buffer_deleter (get_allocator(), capacity()) (this->eback());
+		m_allocated = false;
+	    }
+	}
+
+protected: // data
 
     bool			m_allocated;
+    growth_policy		m_growth;
 };
 
 // ---------------------------------------------------------------------------
@@ -281,6 +410,21 @@ public: // additional convenient methods
     /// \return size of the underlying memory map object.
     size_type map_size () const { return m_view.max_offset(); }
 
+    /// write_to (FILE)
+    /// \brief writes mapped contents from the current get position up to the
+    ///        end of the map into FILE, and moves get position to the end.
+    ///        Holes of the underlying file are not read.  Past the end of
+    ///        FILE, its position is advanced over them instead, so they
+    ///        become holes in FILE too where supported; existing data of
+    ///        FILE is overwritten with zeros.  Holes are written out as zeros
+    ///        as well if FILE is not seekable (pipe, socket) or, on POSIX,
+    ///        open with O_APPEND; on Windows, FILE should not be open for
+    ///        appending only.  Private maps are written as a whole.
+    /// \return number of bytes transferred, holes included.
+    result<size_type> try_write_to (raw_handle file);
+
+    size_type write_to (raw_handle file) { return try_write_to (file).value(); }
+
 private: // methods
 
     // m_seek (OFFSET, WAY)
@@ -318,6 +462,130 @@ private: // data
     mapping::off_type	m_offset; // offset of eback() within m_view
 };
 
+// ---------------------------------------------------------------------------
+/// \class segment_pool
+/// \brief cache of fixed-size memory segments for segmented_buf.
+///
+/// Pool is not thread-safe; share it only between buffers used by the same
+/// thread.  It must outlive buffers that use it.
+
+class SYSPP_DLLIMPORT segment_pool
+{
+public:
+    enum { default_segment_size = 16384, default_max_free = 64 };
+
+    explicit segment_pool (size_t segment_size = default_segment_size,
+			   size_t max_free = default_max_free)
+	: m_segment_size (segment_size), m_max_free (max_free)
+	{ }
+    ~segment_pool ();
+
+    size_t segment_size () const { return m_segment_size; }
+
+    // allocate ()
+    // Returns: pointer to segment_size() bytes of memory.
+
+    char* allocate ();
+
+    // deallocate (SEGMENT)
+    // Effects: returns SEGMENT to the pool, or frees it if pool is full.
+
+    void deallocate (char* segment);
+
+private:
+    segment_pool (const segment_pool&);			// not defined
+    segment_pool& operator= (const segment_pool&);	// not defined
+
+    std::vector<char*>	m_free;
+    size_t		m_segment_size;
+    size_t		m_max_free;
+};
+
+// ---------------------------------------------------------------------------
+/// \class segmented_buf
+/// \brief output stream buffer that stores data in a list of fixed-size
+///        segments.
+///
+/// Unlike dynamic_memory_buf, written data is never moved, so building a large
+/// sequence takes linear time.  Contents are available as a list of spans and
+/// could be written to the file by a single vectored write.
+
+class SYSPP_DLLIMPORT segmented_buf : public std::streambuf
+{
+public: // types
+
+    typedef char				char_type;
+    typedef std::char_traits<char_type>		traits_type;
+    typedef traits_type::int_type 		int_type;
+    typedef traits_type::pos_type 		pos_type;
+    typedef traits_type::off_type 		off_type;
+    typedef size_t				size_type;
+
+    struct span
+    {
+	const char_type*	data;
+	size_type		size;
+    };
+
+    typedef std::vector<span>			span_list;
+
+public: // methods
+
+    explicit segmented_buf (size_type segment_size = segment_pool::default_segment_size)
+	: m_own_pool (segment_size, 4), m_pool (m_own_pool), m_size (0)
+	{ }
+    explicit segmented_buf (segment_pool& pool)
+	: m_own_pool (0, 0), m_pool (pool), m_size (0)
+	{ }
+    virtual ~segmented_buf () { clear(); }
+
+    /// size()
+    /// \return total number of characters written into the buffer.
+    size_type size () const { return m_size + (pptr() - pbase()); }
+
+    bool empty () const { return 0 == size(); }
+
+    /// spans()
+    /// \return list of spans referring to the buffer contents, valid until
+    ///         the next output operation.
+    const span_list& spans ();
+
+    /// clear()
+    /// \brief discards contents and returns segments to the pool.
+    void clear ();
+
+    /// write_to (FILE)
+    /// \brief writes buffer contents to the FILE, using vectored write where
+    ///        available, then clears the buffer.  If writing fails, contents
+    ///        are retained, though some part of them could be already written.
+    /// \return number of bytes written.
+    result<size_type> try_write_to (raw_handle file);
+
+    size_type write_to (raw_handle file) { return try_write_to (file).value(); }
+
+protected: // virtual methods
+
+    int_type overflow (int_type c);
+    std::streamsize xsputn (const char_type* buf, std::streamsize size);
+    pos_type seekoff (off_type off, std::ios::seekdir way, std::ios::openmode mode);
+
+private: // methods
+
+    segmented_buf (const segmented_buf&);		// not defined
+    segmented_buf& operator= (const segmented_buf&);	// not defined
+
+    // m_new_segment ()
+    // Effects: closes current segment and starts the new one.
+    void m_new_segment ();
+
+private: // data
+
+    segment_pool	m_own_pool;
+    segment_pool&	m_pool;
+    span_list		m_spans;	// last span is the current segment
+    size_type		m_size;		// size of all segments but the current
+};
+
 // ---------------------------------------------------------------------------
 
 template <typename C, typename T>
@@ -370,27 +638,55 @@ m_seek (off_type offset, std::ios::seekdir way, std::ios::openmode mode)
 
 // ---------------------------------------------------------------------------
 
-template <typename Ch, typename Tr, typename Al>
-void dynamic_memory_buf<Ch,Tr,Al>::
-m_grow (size_type new_size)
+template <typename Ch, typename Tr, typename Al, typename Gr>
+void dynamic_memory_buf<Ch,Tr,Al,Gr>::
+m_grow (size_type required)
+{
+    size_type new_size = m_growth (capacity() * sizeof(char_type),
+				   required * sizeof(char_type)) / sizeof(char_type);
+    m_reallocate (std::max (new_size, required));
+}
+
+template <typename Ch, typename Tr, typename Al, typename Gr>
+void dynamic_memory_buf<Ch,Tr,Al,Gr>::
+m_reallocate (size_type new_size)
 {
     off_type putpos = this->poffset();
     off_type getpos = this->goffset();
-    size_type alt_size = this->epptr() - this->eback();
-    alt_size += alt_size/2; // grow by half
-    new_size = std::max (alt_size, new_size);
-    char_type* new_buf = this->allocate (new_size);
-    traits_type::copy (new_buf, this->eback(), this->epptr() - this->eback());
-    this->setbuf (new_buf, new_size);
-    m_allocated = true;
+    if (use_realloc && m_allocated)
+    {
+	void* p = std::realloc (this->eback(), new_size * sizeof(char_type));
+	if (!p)
+	    throw std::bad_alloc();
+	base_type::setbuf (static_cast<char_type*> (p), new_size);
+    }
+    else
+    {
+	char_type* new_buf = m_allocate (new_size);
+	traits_type::copy (new_buf, this->eback(), capacity());
+	this->setbuf (new_buf, new_size);
+	m_allocated = true;
+    }
     if (this->m_mode & std::ios::in)
-	gbump (getpos);
+	this->gbump (getpos);
     if (this->m_mode & std::ios::out)
-	pbump (putpos);
+	this->pbump (putpos);
 }
 
-template <typename Ch, typename Tr, typename Al>
-typename dynamic_memory_buf<Ch,Tr,Al>::int_type dynamic_memory_buf<Ch,Tr,Al>::
+template <typename Ch, typename Tr, typename Al, typename Gr>
+typename dynamic_memory_buf<Ch,Tr,Al,Gr>::buffer_ptr dynamic_memory_buf<Ch,Tr,Al,Gr>::
+release ()
+{
+    if (!m_allocated && capacity())
+	m_reallocate (capacity());
+    buffer_ptr result (this->eback(), buffer_deleter (get_allocator(), capacity()));
+    m_allocated = false;
+    base_type::setbuf (0, 0);
+    return result;
+}
+
+template <typename Ch, typename Tr, typename Al, typename Gr>
+typename dynamic_memory_buf<Ch,Tr,Al,Gr>::int_type dynamic_memory_buf<Ch,Tr,Al,Gr>::
 overflow (int_type c)
 {
     if (traits_type::eq_int_type (c, traits_type::eof()))
@@ -399,7 +695,7 @@ overflow (int_type c)
 	return traits_type::eof();
 
     if (this->pptr() == this->epptr())
-	m_grow (this->psize() + GROW_SIZE);
+	m_grow (this->poffset() + 1);
 
     *this->pptr() = traits_type::to_char_type (c);
     this->pbump (1);
@@ -407,17 +703,14 @@ overflow (int_type c)
     return (c);
 }
 
-template <typename Ch, typename Tr, typename Al>
-std::streamsize dynamic_memory_buf<Ch,Tr,Al>::
+template <typename Ch, typename Tr, typename Al, typename Gr>
+std::streamsize dynamic_memory_buf<Ch,Tr,Al,Gr>::
 xsputn (const char_type* buf, std::streamsize size)
 {
     if (!(this->m_mode & std::ios::out))
 	return 0;
     if (size > static_cast<std::streamsize> (this->epptr() - this->pptr()))
-    {
-	size_type cur_size = this->epptr() - this->pbase();
-	m_grow (this->psize() + size + GROW_SIZE);
-    }
+	m_grow (this->poffset() + size);
     traits_type::copy (this->pptr(), buf, size);
     this->pbump (size);
     return size;
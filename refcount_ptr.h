@@ -30,25 +30,114 @@
 #include "sysdef.h"
 #include "sysatomic.h"
 #include <algorithm>	// for std::swap
+#include <memory>	// for std::allocator, std::allocator_traits
+#include <utility>	// for std::forward
+#include <cstdint>	// for std::uintptr_t
+#include <cassert>
 #ifdef SYSPP_REFCOUNT_PTR_USE_AUTO_PTR
 #include <memory>	// for std::auto_ptr
 #endif
 
 namespace sys {
 
-class SYSPP_DLLIMPORT refcount_base
+//  reference counter policies  ----------------------------------------------
+
+/// \class atomic_counter
+/// \brief thread-safe reference counter.
+///
+/// Taking a reference needs no ordering, since it is always done through an
+/// existing one.  Dropping a reference is a release operation, and the thread
+/// that drops the last one issues an acquire fence before deleting the object,
+/// so that all writes made through other references happen before deletion.
+
+class atomic_counter
 {
-    mutable volatile sys::atomic_type ref_count;
+public:
+    atomic_counter () : m_count (0) { }
 
-    template<typename T> friend class refcount_ptr;
+    void add_ref () { m_count.fetch_add (1, memory_order_relaxed); }
+    void add_ref (long n) { m_count.fetch_add (n, memory_order_relaxed); }
 
+    // release ()
+    // Returns: true if the last reference was dropped.
+
+    bool release ()
+	{
+#if defined(__SANITIZE_THREAD__)
+	    // thread sanitizer does not track standalone fences
+	    return m_count.fetch_sub (1, memory_order_acq_rel) == 1;
+#else
+	    if (m_count.fetch_sub (1, memory_order_release) != 1)
+		return false;
+	    std::atomic_thread_fence (memory_order_acquire);
+	    return true;
+#endif
+	}
+
+    long get () const { return m_count.load (memory_order_relaxed); }
+    void set (long count) { m_count.store (count, memory_order_relaxed); }
+
+private:
+    sys::atomic<long>	m_count;
+};
+
+/// \class local_counter
+/// \brief non-atomic reference counter, for objects never shared between
+/// threads.
+
+class local_counter
+{
 public:
-    refcount_base() : ref_count(0) { }
+    local_counter () : m_count (0) { }
+
+    void add_ref () { ++m_count; }
+    void add_ref (long n) { m_count += n; }
+    bool release () { return 0 == --m_count; }
+    long get () const { return m_count; }
+    void set (long count) { m_count = count; }
+
+private:
+    long	m_count;
+};
+
+namespace detail { struct refcount_access; }
+
+/// \class basic_refcount_base
+/// \brief base class for objects managed by refcount_ptr.
+///
+/// Counter is the counter policy, atomic_counter or local_counter.  Copies of
+/// the object start with the reference count of zero.
+///
+/// When the last reference is dropped, object is destroyed by its disposer
+/// function, if one was attached by refcount_ptr constructor with deleter or
+/// by allocate_refcounted, or else by delete expression.
+
+template <class Counter>
+class basic_refcount_base
+{
+public:
+    typedef Counter counter_type;
+    typedef void (*disposer_type) (basic_refcount_base*);
+
+    basic_refcount_base () : dispose_fn (0) { }
+    basic_refcount_base (const basic_refcount_base&) : dispose_fn (0) { }
+    basic_refcount_base& operator= (const basic_refcount_base&) { return *this; }
+
+private:
+    mutable Counter ref_count;
+    disposer_type   dispose_fn;
+
+    template<typename T> friend class refcount_ptr;
+    template<typename T> friend class atomic_refcount_ptr;
+    friend struct detail::refcount_access;
 };
 
+typedef basic_refcount_base<atomic_counter>	refcount_base;
+typedef basic_refcount_base<local_counter>	local_refcount_base;
+
 //  refcount_ptr  ------------------------------------------------------------
 //
-//  Requirements: For ptr of type T*, ptr->ref_count must be initialized to 0
+//  Requirements: T is derived from refcount_base or local_refcount_base.
 
 template<typename T>
 class SYSPP_DLLIMPORT refcount_ptr
@@ -56,6 +145,7 @@ class SYSPP_DLLIMPORT refcount_ptr
     T*		ptr;
 
     template<typename U> friend class refcount_ptr;
+    template<typename U> friend class atomic_refcount_ptr;
 
 public:
     typedef T element_type;
@@ -63,10 +153,10 @@ public:
     // XXX enabled implicit conversion
     //
     /*explicit*/ refcount_ptr (T* p = 0) : ptr (p)
-       	{ if (ptr) sys::atomic_add (ptr->ref_count, 1); }
+       	{ if (ptr) ptr->ref_count.add_ref(); }
 
     refcount_ptr (const refcount_ptr& other) : ptr (other.ptr)
-       	{ if (ptr) sys::atomic_add (ptr->ref_count, 1); }
+       	{ if (ptr) ptr->ref_count.add_ref(); }
 
     refcount_ptr (refcount_ptr&& other) : ptr (other.ptr)
         { other.ptr = 0; }
@@ -75,18 +165,34 @@ public:
 
     template<typename U>
     refcount_ptr (const refcount_ptr<U>& r) : ptr (r.ptr)
-       	{ if (ptr) sys::atomic_add (ptr->ref_count, 1); }
+       	{ if (ptr) ptr->ref_count.add_ref(); }
 
     template<typename U>
     refcount_ptr (refcount_ptr<U>&& other) : ptr (other.ptr)
         { other.ptr = 0; }
 
+    // refcount_ptr (P, DELETER)
+    // Effects: takes reference to P, which is destroyed by expression
+    //          Deleter()(P) when the last reference is dropped.
+    // Requires: Deleter is default-constructible; its state, if any, is not
+    //           retained.
+
+    template<typename Deleter>
+    refcount_ptr (T* p, Deleter) : ptr (p)
+	{
+	    if (ptr)
+	    {
+		ptr->dispose_fn = &disposer<Deleter>::dispose;
+		ptr->ref_count.add_ref();
+	    }
+	}
+
 #if SYSPP_REFCOUNT_PTR_USE_AUTO_PTR
     template<typename U>
     refcount_ptr (std::auto_ptr<U>& r)
        	{
 	    ptr = r.release();
-	    if (ptr) sys::atomic_swap (ptr->ref_count, 1);
+	    if (ptr) ptr->ref_count.set (1);
 	}
 
     template<typename U>
@@ -94,7 +200,7 @@ public:
        	{
 	    dispose();
 	    ptr = r.release();
-	    if (ptr) sys::atomic_swap (ptr->ref_count, 1);
+	    if (ptr) ptr->ref_count.set (1);
 	    return *this;
 	}
 #endif // SYSPP_REFCOUNT_PTR_USE_AUTO_PTR
@@ -151,16 +257,31 @@ public:
 
     bool operator! () const { return ptr == 0; }
 
-    long use_count () const { return ptr ? ptr->ref_count : 0; }
-    bool unique () const { return ptr && ptr->ref_count == 1; }
+    long use_count () const { return ptr ? ptr->ref_count.get() : 0; }
+    bool unique () const { return ptr && ptr->ref_count.get() == 1; }
 
     void swap (refcount_ptr<T>& other) { std::swap (ptr, other.ptr); }
 
 private:
+    // T is not required to be complete until the pointer is disposed
+    template<typename Deleter>
+    struct disposer
+    {
+	typedef basic_refcount_base<typename T::counter_type> base_type;
+
+	static void dispose (base_type* obj)
+	    { Deleter() (static_cast<T*> (obj)); }
+    };
+
     void dispose ()
 	{
-	    if (ptr && sys::atomic_add (ptr->ref_count, -1) == 1)
-		delete ptr;
+	    if (ptr && ptr->ref_count.release())
+	    {
+		if (ptr->dispose_fn)
+		    ptr->dispose_fn (ptr);
+		else
+		    delete ptr;
+	    }
 	}
 
     void share (T* other)
@@ -169,7 +290,7 @@ private:
 	    {
 		dispose();
 		ptr = other;
-		if (ptr) sys::atomic_add (ptr->ref_count, 1);
+		if (ptr) ptr->ref_count.add_ref();
 	    }
 	}
 };
@@ -186,6 +307,237 @@ inline bool operator!= (const refcount_ptr<T1>& lhs, const refcount_ptr<T2>& rhs
     return lhs.get() != rhs.get();
 }
 
+//  make_refcounted  ---------------------------------------------------------
+
+namespace detail {
+
+struct refcount_access
+{
+    template<typename T, typename Disposer>
+    static void set_disposer (T* obj, Disposer dispose)
+	{ obj->dispose_fn = dispose; }
+};
+
+// object allocated by allocate_refcounted together with a copy of allocator
+// that is used to free it.
+
+template<typename T, typename Alloc>
+class refcounted_object : public T
+{
+public:
+    typedef typename std::allocator_traits<Alloc>::template
+			rebind_alloc<refcounted_object>	allocator_type;
+    typedef std::allocator_traits<allocator_type>	traits_type;
+    typedef basic_refcount_base<typename T::counter_type> base_type;
+
+    template<typename... Args>
+    explicit refcounted_object (const allocator_type& alloc, Args&&... args)
+	: T (std::forward<Args> (args)...), m_alloc (alloc)
+	{ }
+
+    static void dispose (base_type* obj)
+	{
+	    refcounted_object* self = static_cast<refcounted_object*> (obj);
+	    allocator_type alloc (self->m_alloc);
+	    traits_type::destroy (alloc, self);
+	    traits_type::deallocate (alloc, self, 1);
+	}
+
+private:
+    allocator_type	m_alloc;
+};
+
+} // namespace detail
+
+// make_refcounted<T> (ARGS)
+// Returns: reference to new object of type T constructed from ARGS.
+
+template<typename T, typename... Args>
+inline refcount_ptr<T> make_refcounted (Args&&... args)
+{
+    return refcount_ptr<T> (new T (std::forward<Args> (args)...));
+}
+
+// allocate_refcounted<T> (ALLOC, ARGS)
+// Effects: allocates object of type T using copy of ALLOC and constructs it
+//          from ARGS.  Object is destroyed and freed by the same allocator.
+// Returns: reference to the new object.
+
+template<typename T, typename Alloc, typename... Args>
+refcount_ptr<T> allocate_refcounted (const Alloc& alloc, Args&&... args)
+{
+    typedef detail::refcounted_object<T, Alloc>	object_type;
+    typedef typename object_type::traits_type	traits_type;
+
+    typename object_type::allocator_type a (alloc);
+    object_type* obj = traits_type::allocate (a, 1);
+    try
+    {
+	traits_type::construct (a, obj, a, std::forward<Args> (args)...);
+    }
+    catch (...)
+    {
+	traits_type::deallocate (a, obj, 1);
+	throw;
+    }
+    detail::refcount_access::set_disposer (obj, &object_type::dispose);
+    return refcount_ptr<T> (obj);
+}
+
+//  atomic_refcount_ptr  -----------------------------------------------------
+//
+//  Slot holding refcount_ptr<T> that may be loaded and replaced concurrently,
+//  intended for publishing read-mostly objects to many reader threads.
+//
+//  Implementation uses split reference counting: pointer shares a single
+//  64-bit word with a count of references borrowed by readers.  load() takes
+//  a reference by incrementing that count in one wait-free atomic addition,
+//  then moves it to the object's own counter.  Replacing the pointer
+//  transfers the borrowed count to the counter of the old object, so it is
+//  never freed under a reader.
+//
+//  Requirements: T is derived from refcount_base.  On 64-bit platforms
+//  pointers must fit in 48 bits, which is the case for user space addresses
+//  on x86-64 and AArch64.
+
+template<typename T>
+class atomic_refcount_ptr
+{
+public:
+    typedef refcount_ptr<T> value_type;
+
+    atomic_refcount_ptr () : m_word (0) { }
+    explicit atomic_refcount_ptr (refcount_ptr<T> p) : m_word (pack (p)) { }
+    ~atomic_refcount_ptr () { adopt (m_word.load (memory_order_relaxed)); }
+
+    // load ()
+    // Returns: reference to the stored object.
+
+    refcount_ptr<T> load () const;
+
+    // store (P)
+    // Effects: replaces stored object with P.
+
+    void store (refcount_ptr<T> p) { exchange (std::move (p)); }
+
+    // exchange (P)
+    // Effects: replaces stored object with P.
+    // Returns: reference to the previously stored object.
+
+    refcount_ptr<T> exchange (refcount_ptr<T> p)
+	{ return adopt (m_word.exchange (pack (p), memory_order_acq_rel)); }
+
+    // compare_exchange (EXPECTED, DESIRED)
+    // Effects: if stored object is EXPECTED, replaces it with DESIRED,
+    //          otherwise assigns stored object to EXPECTED.
+    // Returns: true if object was replaced.
+
+    bool compare_exchange (refcount_ptr<T>& expected, refcount_ptr<T> desired);
+
+    operator refcount_ptr<T> () const { return load(); }
+
+    atomic_refcount_ptr& operator= (refcount_ptr<T> p)
+	{
+	    store (std::move (p));
+	    return *this;
+	}
+
+    static bool is_lock_free () { return sys::atomic<word_type>::is_lock_free(); }
+
+private:
+    typedef bin::uint64_t word_type;
+
+    atomic_refcount_ptr (const atomic_refcount_ptr&);		// not defined
+    atomic_refcount_ptr& operator= (const atomic_refcount_ptr&);	// not defined
+
+    SYSPP_static_constexpr unsigned count_shift = sizeof(void*) > 4 ? 48 : 32;
+    SYSPP_static_constexpr word_type count_one = word_type (1) << count_shift;
+    SYSPP_static_constexpr word_type ptr_mask = count_one - 1;
+
+    static T* get_ptr (word_type word)
+	{ return reinterpret_cast<T*> (static_cast<std::uintptr_t> (word & ptr_mask)); }
+    static long get_count (word_type word)
+	{ return static_cast<long> (word >> count_shift); }
+
+    // pack (P)
+    // Effects: moves reference held by P into the word.
+    // Returns: word holding pointer with zero borrowed count.
+
+    static word_type pack (refcount_ptr<T>& p)
+	{
+	    word_type word = reinterpret_cast<std::uintptr_t> (p.ptr);
+	    assert (0 == (word & ~ptr_mask));
+	    p.ptr = 0;
+	    return word;
+	}
+
+    // adopt (WORD)
+    // Effects: moves reference held by WORD into refcount_ptr, adding its
+    //          borrowed count to the object's counter.
+
+    static refcount_ptr<T> adopt (word_type word)
+	{
+	    refcount_ptr<T> result;
+	    if (T* p = get_ptr (word))
+	    {
+		if (long count = get_count (word))
+		    p->ref_count.add_ref (count);
+		result.ptr = p;
+	    }
+	    return result;
+	}
+
+    mutable sys::atomic<word_type>	m_word;
+};
+
+template<typename T>
+refcount_ptr<T> atomic_refcount_ptr<T>::
+load () const
+{
+    word_type word = m_word.fetch_add (count_one, memory_order_acquire);
+    T* p = get_ptr (word);
+    refcount_ptr<T> result;
+    if (p)
+    {
+	p->ref_count.add_ref();
+	result.ptr = p;
+    }
+    // return borrowed reference.  release ordering makes the increment above
+    // visible to the thread that replaces the pointer and reads the count.
+    word += count_one;
+    while (get_ptr (word) == p && get_count (word) > 0)
+    {
+	if (m_word.compare_exchange_weak (word, word - count_one,
+					  memory_order_release, memory_order_relaxed))
+	    return result;
+    }
+    // pointer was replaced and borrowed reference was moved to the object's
+    // counter, release it there.
+    if (p)
+	p->ref_count.release();
+    return result;
+}
+
+template<typename T>
+bool atomic_refcount_ptr<T>::
+compare_exchange (refcount_ptr<T>& expected, refcount_ptr<T> desired)
+{
+    word_type word = m_word.load (memory_order_relaxed);
+    word_type desired_word = reinterpret_cast<std::uintptr_t> (desired.get());
+    while (get_ptr (word) == expected.get())
+    {
+	if (m_word.compare_exchange_weak (word, desired_word,
+					  memory_order_acq_rel, memory_order_relaxed))
+	{
+	    desired.ptr = 0;
+	    adopt (word);
+	    return true;
+	}
+    }
+    expected = load();
+    return false;
+}
+
 // get_pointer() enables boost::mem_fn to recognize refcount_ptr
 
 template <typename T>
@@ -0,0 +1,128 @@
+// -*- C++ -*-
+//! \file       sysarena.cc
+//! \brief      monotonic memory arena implementation.
+//
+// Copyright (C) 2007 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#include "sysarena.h"
+#include <cstdlib>	// for std::malloc, std::free
+
+namespace sys {
+
+namespace {
+
+// size of the chunk header, rounded up to keep data maximally aligned
+const size_t header_size = (sizeof(void*) * 2 + alignof(std::max_align_t) - 1)
+			   & ~(alignof(std::max_align_t) - 1);
+
+void* allocate_block (size_t size)
+{
+    void* block = std::malloc (size);
+    if (!block)
+	throw std::bad_alloc();
+    return block;
+}
+
+} // anonymous namespace
+
+arena::
+arena (size_t chunk_size)
+    : m_chunks (0), m_free (0), m_large (0), m_ptr (0), m_end (0)
+    , m_chunk_size (chunk_size)
+{
+}
+
+char* arena::
+data (chunk* c)
+{
+    return reinterpret_cast<char*> (c) + header_size;
+}
+
+void* arena::
+allocate_slow (size_t size, size_t align)
+{
+    if (size + align > m_chunk_size)
+    {
+	if (size + align < size)
+	    throw std::bad_alloc();
+	chunk* block = static_cast<chunk*> (allocate_block (header_size + size + align));
+	block->size = size + align;
+	block->next = m_large;
+	m_large = block;
+	return align_up (data (block), align);
+    }
+    chunk* c = m_free;
+    if (c)
+	m_free = c->next;
+    else
+    {
+	c = static_cast<chunk*> (allocate_block (header_size + m_chunk_size));
+	c->size = m_chunk_size;
+    }
+    c->next = m_chunks;
+    m_chunks = c;
+    char* p = align_up (data (c), align);
+    m_ptr = p + size;
+    m_end = data (c) + c->size;
+    return p;
+}
+
+void arena::
+rewind (const marker& mark)
+{
+    while (m_chunks != mark.m_chunk)
+    {
+	chunk* c = m_chunks;
+	m_chunks = c->next;
+	c->next = m_free;
+	m_free = c;
+    }
+    while (m_large != mark.m_large)
+    {
+	chunk* block = m_large;
+	m_large = block->next;
+	std::free (block);
+    }
+    m_ptr = mark.m_ptr;
+    m_end = m_chunks ? data (m_chunks) + m_chunks->size : 0;
+}
+
+void arena::
+release ()
+{
+    reset();
+    while (m_free)
+    {
+	chunk* c = m_free;
+	m_free = c->next;
+	std::free (c);
+    }
+}
+
+arena&
+thread_arena ()
+{
+    static thread_local arena instance;
+    return instance;
+}
+
+} // namespace sys
@@ -0,0 +1,240 @@
+// -*- C++ -*-
+//! \file       sysarena.h
+//! \brief      monotonic memory arena and allocator on top of it.
+//
+// Copyright (C) 2007 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#ifndef SYSARENA_H
+#define SYSARENA_H
+
+#include "sysdef.h"
+#include "sysstring.h"
+#include <cstddef>	// for std::size_t, std::max_align_t
+#include <new>		// for std::bad_alloc
+
+namespace sys {
+
+// ---------------------------------------------------------------------------
+/// \class arena
+/// \brief monotonic memory allocator.
+///
+/// Memory is carved sequentially from chunks of fixed size; individual blocks
+/// are not freed, except for the most recently allocated one.  All memory is
+/// released at once by reset(), or back to the marked position by rewind();
+/// released chunks are kept for reuse.  Blocks larger than a chunk get
+/// dedicated allocations that are returned to the system on reset.
+///
+/// Arena is not thread-safe.
+
+class SYSPP_DLLIMPORT arena
+{
+    struct chunk
+    {
+	chunk*	next;
+	size_t	size;		// size of the data area
+    };
+
+public:
+    enum { default_chunk_size = 65536 };
+
+    /// \class marker
+    /// \brief arena position saved by mark().
+    class marker
+    {
+    public:
+	marker () : m_chunk (0), m_ptr (0), m_large (0) { }
+
+    private:
+	chunk*	m_chunk;
+	char*	m_ptr;
+	chunk*	m_large;
+
+	friend class arena;
+    };
+
+    explicit arena (size_t chunk_size = default_chunk_size);
+    ~arena () { release(); }
+
+    // allocate (SIZE, ALIGN)
+    // Returns: pointer to SIZE bytes aligned on ALIGN boundary, which must be
+    //          a power of 2.
+    // Throws: std::bad_alloc
+
+    void* allocate (size_t size, size_t align = alignof(std::max_align_t))
+	{
+	    char* p = align_up (m_ptr, align);
+	    if (p && size <= static_cast<size_t> (m_end - p))
+	    {
+		m_ptr = p + size;
+		return p;
+	    }
+	    return allocate_slow (size, align);
+	}
+
+    // deallocate (PTR, SIZE)
+    // Effects: returns memory to the arena if PTR is the last allocated block,
+    //          otherwise does nothing.
+
+    void deallocate (void* ptr, size_t size)
+	{
+	    if (static_cast<char*> (ptr) + size == m_ptr)
+		m_ptr = static_cast<char*> (ptr);
+	}
+
+    // mark ()
+    // Returns: current position of the arena.
+
+    marker mark () const
+	{
+	    marker m;
+	    m.m_chunk = m_chunks;
+	    m.m_ptr = m_ptr;
+	    m.m_large = m_large;
+	    return m;
+	}
+
+    // rewind (MARK)
+    // Effects: frees all memory allocated since MARK was taken.
+
+    void rewind (const marker& mark);
+
+    // reset ()
+    // Effects: frees all memory allocated from the arena, retaining chunks.
+
+    void reset () { rewind (marker()); }
+
+    // release ()
+    // Effects: frees all memory and returns chunks to the system.
+
+    void release ();
+
+    size_t chunk_size () const { return m_chunk_size; }
+
+private:
+    arena (const arena&);		// not defined
+    arena& operator= (const arena&);	// not defined
+
+    static char* align_up (char* p, size_t align)
+	{
+	    std::size_t addr = reinterpret_cast<std::size_t> (p);
+	    return reinterpret_cast<char*> ((addr + align - 1) & ~(align - 1));
+	}
+
+    static char* data (chunk* c);
+
+    void* allocate_slow (size_t size, size_t align);
+
+    chunk*	m_chunks;	// chunks in use, current first
+    chunk*	m_free;		// recycled chunks
+    chunk*	m_large;	// dedicated blocks
+    char*	m_ptr;
+    char*	m_end;
+    size_t	m_chunk_size;
+};
+
+// thread_arena ()
+// Returns: arena owned by the calling thread.
+
+SYSPP_DLLIMPORT arena& thread_arena ();
+
+/// \class arena_scope
+/// \brief frees memory allocated from the arena during the scope lifetime.
+
+class arena_scope
+{
+public:
+    explicit arena_scope (arena& a = thread_arena ()) : m_arena (a), m_mark (a.mark()) { }
+    ~arena_scope () { m_arena.rewind (m_mark); }
+
+    arena& get () const { return m_arena; }
+
+private:
+    arena_scope (const arena_scope&);			// not defined
+    arena_scope& operator= (const arena_scope&);	// not defined
+
+    arena&		m_arena;
+    arena::marker	m_mark;
+};
+
+// ---------------------------------------------------------------------------
+/// \class arena_allocator
+/// \brief standard allocator drawing memory from sys::arena.
+///
+/// Default-constructed allocator uses arena of the calling thread.  It could
+/// be used with containers, local_buffer and dynamic_memory_buf, e.g.
+///
+///   dynamic_memory_buf<char, std::char_traits<char>, arena_allocator<char> >
+
+template <typename T>
+class arena_allocator
+{
+public:
+    typedef T			value_type;
+    typedef T*			pointer;
+    typedef const T*		const_pointer;
+    typedef T&			reference;
+    typedef const T&		const_reference;
+    typedef std::size_t		size_type;
+    typedef std::ptrdiff_t	difference_type;
+
+    template <typename U> struct rebind { typedef arena_allocator<U> other; };
+
+    arena_allocator () : m_arena (&thread_arena()) { }
+    arena_allocator (arena& a) : m_arena (&a) { }
+    template <typename U>
+    arena_allocator (const arena_allocator<U>& other) : m_arena (other.get_arena()) { }
+
+    T* allocate (size_type n)
+	{
+	    if (n > max_size())
+		throw std::bad_alloc();
+	    return static_cast<T*> (m_arena->allocate (n * sizeof(T), alignof(T)));
+	}
+
+    void deallocate (T* p, size_type n) { m_arena->deallocate (p, n * sizeof(T)); }
+
+    size_type max_size () const { return size_type (-1) / sizeof(T); }
+
+    arena* get_arena () const { return m_arena; }
+
+private:
+    arena*	m_arena;
+};
+
+template <typename T, typename U>
+inline bool operator== (const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{ return lhs.get_arena() == rhs.get_arena(); }
+
+template <typename T, typename U>
+inline bool operator!= (const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{ return lhs.get_arena() != rhs.get_arena(); }
+
+#ifndef SYSPP_USE_EXT_STRING
+typedef basic_string<char, std::char_traits<char>, arena_allocator<char> >
+	arena_string;
+typedef basic_string<WChar, std::char_traits<WChar>, arena_allocator<WChar> >
+	arena_wstring;
+#endif
+
+} // namespace sys
+
+#endif /* SYSARENA_H */
@@ -1,7 +1,7 @@
 // -*- C++ -*-
 //! \file       sysatomic.h
 //! \date       Fri Mar 23 11:31:06 2007
-//! \brief      atomic exchange/add inline functions.
+//! \brief      atomic operations with explicit memory ordering.
 //
 // Copyright (C) 2007 by poddav
 //
@@ -27,13 +27,120 @@
 #ifndef SYSATOMIC_HPP
 #define SYSATOMIC_HPP
 
+#include "sysdef.h"
 #include "bindata.h"
+#include <atomic>
 #if SYSPP_MSC
 #include <intrin.h>
 #endif
 
 namespace sys {
 
+using std::memory_order;
+using std::memory_order_relaxed;
+using std::memory_order_consume;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_acq_rel;
+using std::memory_order_seq_cst;
+
+/// \class atomic
+/// \brief atomic value of integral or pointer type T.
+///
+/// Every operation takes memory ordering as its last argument.  Loads and
+/// stores compile to plain moves on x86; read-modify-write operations are
+/// the only ones that lock the cache line.
+
+template <typename T>
+class atomic
+{
+public:
+    typedef T	value_type;
+
+    SYSPP_constexpr atomic () SYSPP_noexcept : m_value() { }
+    SYSPP_constexpr atomic (T value) SYSPP_noexcept : m_value (value) { }
+
+    // load (ORDER)
+    // Returns: current value.
+
+    T load (memory_order order = memory_order_seq_cst) const SYSPP_noexcept
+	{ return m_value.load (order); }
+
+    // store (VALUE, ORDER)
+    // Effects: replaces current value with VALUE.
+
+    void store (T value, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ m_value.store (value, order); }
+
+    // exchange (VALUE, ORDER)
+    // Effects: replaces current value with VALUE.
+    // Returns: previous value.
+
+    T exchange (T value, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.exchange (value, order); }
+
+    // compare_exchange (EXPECTED, DESIRED, SUCCESS, FAILURE)
+    // Effects: if current value equals EXPECTED, replaces it with DESIRED,
+    //          otherwise stores current value into EXPECTED.  SUCCESS and
+    //          FAILURE are memory orderings of the respective outcomes.
+    // Returns: true if value was replaced.
+
+    bool compare_exchange (T& expected, T desired,
+			   memory_order success = memory_order_seq_cst,
+			   memory_order failure = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.compare_exchange_strong (expected, desired, success, failure); }
+
+    // compare_exchange_weak (EXPECTED, DESIRED, SUCCESS, FAILURE)
+    // Same as compare_exchange, but may fail spuriously; intended for loops.
+
+    bool compare_exchange_weak (T& expected, T desired,
+				memory_order success = memory_order_seq_cst,
+				memory_order failure = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.compare_exchange_weak (expected, desired, success, failure); }
+
+    // fetch_add (ARG, ORDER), fetch_sub (ARG, ORDER)
+    // Effects: atomically adds ARG to (subtracts ARG from) current value.
+    // Returns: previous value.
+
+    template <typename Arg>
+    T fetch_add (Arg arg, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.fetch_add (arg, order); }
+
+    template <typename Arg>
+    T fetch_sub (Arg arg, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.fetch_sub (arg, order); }
+
+    // fetch_or (ARG, ORDER), fetch_and (ARG, ORDER), fetch_xor (ARG, ORDER)
+    // Effects: atomic bitwise operation on current value; integral T only.
+    // Returns: previous value.
+
+    T fetch_or (T arg, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.fetch_or (arg, order); }
+
+    T fetch_and (T arg, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.fetch_and (arg, order); }
+
+    T fetch_xor (T arg, memory_order order = memory_order_seq_cst) SYSPP_noexcept
+	{ return m_value.fetch_xor (arg, order); }
+
+    static bool is_lock_free () SYSPP_noexcept
+	{ return std::atomic<T>().is_lock_free(); }
+
+private:
+    atomic (const atomic&);		// not defined
+    atomic& operator= (const atomic&);	// not defined
+
+    std::atomic<T>	m_value;
+};
+
+typedef atomic<bin::int32_t>	atomic32;
+typedef atomic<bin::uint32_t>	uatomic32;
+typedef atomic<bin::int64_t>	atomic64;
+typedef atomic<bin::uint64_t>	uatomic64;
+
+// ---------------------------------------------------------------------------
+// Legacy interface on plain integers; new code should use sys::atomic.
+
 #if SYSPP_MSC || SYSPP_WIN32 && !SYSPP_GNUC && !SYSPP_CLANG
 typedef long atomic_type;
 #else
@@ -48,14 +155,31 @@ atomic_type atomic_add (volatile atomic_type& value, atomic_type increment);
 
 atomic_type atomic_swap (volatile atomic_type& value, atomic_type replacement);
 
-// atomically read value
+// atomically read value, with acquire semantics
 
 atomic_type atomic_get (volatile atomic_type& value);
 
 // ---------------------------------------------------------------------------
 // implementation
 
-#if SYSPP_CLANG || SYSPP_GNUC && __GCC_HAVE_SYNC_COMPARE_AND_SWAP_4
+#if SYSPP_CLANG || SYSPP_GNUC >= 40700
+
+inline atomic_type atomic_add (volatile atomic_type& value, atomic_type increment)
+{
+    return __atomic_fetch_add (&value, increment, __ATOMIC_SEQ_CST);
+}
+
+inline atomic_type atomic_swap (volatile atomic_type& value, atomic_type replacement)
+{
+    return __atomic_exchange_n (&value, replacement, __ATOMIC_SEQ_CST);
+}
+
+inline atomic_type atomic_get (volatile atomic_type& value)
+{
+    return __atomic_load_n (&value, __ATOMIC_ACQUIRE);
+}
+
+#elif SYSPP_GNUC && __GCC_HAVE_SYNC_COMPARE_AND_SWAP_4
 
 inline atomic_type atomic_add (volatile atomic_type& value, atomic_type increment)
 {
@@ -69,7 +193,14 @@ inline atomic_type atomic_swap (volatile atomic_type& value, atomic_type replace
 
 inline atomic_type atomic_get (volatile atomic_type& value)
 {
-    return __sync_val_compare_and_swap (&value, 0, 0);
+    atomic_type result = value;
+#if defined(__i386__) || defined(__x86_64__)
+    // loads are not reordered with other loads on x86
+    __asm__ __volatile__ ("" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+    return result;
 }
 
 #elif SYSPP_GNUC && defined(__i386__)
@@ -100,13 +231,8 @@ inline atomic_type atomic_swap (volatile atomic_type& value, atomic_type replace
 
 inline atomic_type atomic_get (volatile atomic_type& value)
 {
-    atomic_type result;
-    __asm__ __volatile__ (
-        "xor	%%eax, %%eax\n\t"
-	"lock\n\t"
-	"cmpxchg	%1, %0"
-	: "+m" (value), "=a" (result)
-    );
+    atomic_type result = value;
+    __asm__ __volatile__ ("" ::: "memory");
     return result;
 }
 
@@ -124,7 +250,13 @@ inline atomic_type atomic_swap (volatile atomic_type& value, atomic_type replace
 
 inline atomic_type atomic_get (volatile atomic_type& value)
 {
+#if defined(_M_IX86) || defined(_M_X64)
+    atomic_type result = value;
+    _ReadWriteBarrier();
+    return result;
+#else
     return _InterlockedCompareExchange (&value, 0, 0);
+#endif
 }
 
 #elif defined(_WIN32)
@@ -31,8 +31,9 @@
 #include <windows.h>
 #else
 #include <dlfcn.h>
-#include "sysstring.h"	// for wcstombs()
 #endif
+#include "sysstring.h"	// for wcstombs()
+#include "syserror.h"	// for sys::result
 
 namespace sys {
 
@@ -49,6 +50,10 @@ typedef void*	proc_type;
 module_type load_library (const char* name);
 module_type load_library (const WChar* name);
 
+// library_error()
+// Returns: error code of the last failed library function.
+int library_error ();
+
 } // namespace detail
 
 class library
@@ -57,6 +62,8 @@ public:
     typedef detail::module_type module_type;
     typedef detail::proc_type	proc_type;
 
+    library () : lib (0) { }
+
     template <typename char_type>
     explicit library (const char_type* name) : lib (detail::load_library (name)) { }
 
@@ -70,14 +77,36 @@ public:
     module_type	get_handle () const { return lib; }
     void	close ();
 
+    // try_open (NAME)
+    // Effects: closes currently loaded library, if any, and loads library NAME.
+    // Returns: system error code if library cannot be loaded.
+
+    template <typename char_type>
+    result<void> try_open (const char_type* name)
+	{
+	    close();
+	    lib = detail::load_library (name);
+	    if (!lib)
+		return error_code (detail::library_error());
+	    return result<void>();
+	}
+
+    // try_get_proc (SYMBOL)
+    // Returns: address of the exported SYMBOL, or system error code.
+
+    result<proc_type> try_get_proc (const char* symbol) const
+	{
+	    if (proc_type proc = get_proc (symbol))
+		return proc;
+	    return error_code (detail::library_error());
+	}
+
 protected:
-    library () { }
+    module_type		lib;
 
 private:
     library (const library&); // not defined
     library& operator= (const library&); 
-
-    module_type		lib;
 };
 
 class library_throw : private library
@@ -115,6 +144,12 @@ load_library (const WChar* name)
     return ::LoadLibraryW (name);
 }
 
+inline int detail::
+library_error ()
+{
+    return ::GetLastError();
+}
+
 inline void library::
 close ()
 {
@@ -125,8 +160,8 @@ close ()
     }
 }
 
-inline proc_type library::
-get_proc (const char* symbol)
+inline library::proc_type library::
+get_proc (const char* symbol) const
 {
     return lib? ::GetProcAddress (lib, symbol): 0;
 }
@@ -138,9 +173,8 @@ library_throw (const char_type* name)
     if (!lib) SYS_THROW_GENERIC_ERROR (name);
 }
 
-template <typename char_type>
-inline proc_type library_throw::
-get_proc (const char_type* symbol)
+inline library_throw::proc_type library_throw::
+get_proc (const char* symbol) const
 {
     proc_type proc = library::get_proc (symbol);
     if (!proc)
@@ -153,6 +187,7 @@ get_proc (const char_type* symbol)
 inline detail::module_type detail::
 load_library (const char* name)
 {
+    errno = 0;
     return ::dlopen (name, RTLD_LAZY);
 }
 
@@ -160,9 +195,40 @@ inline detail::module_type detail::
 load_library (const WChar* name)
 {
     string cname;
-    return wcstombs (name, cname) && ::dlopen (cname.c_str(), RTLD_LAZY);
+    if (!wcstombs (name, cname))
+	return 0;
+    errno = 0;
+    return ::dlopen (cname.c_str(), RTLD_LAZY);
 }
 
+// dl* functions don't set errno, so errno is cleared before calling them and
+// library_error() reports it only if it was set by the failed call.
+
+inline int detail::
+library_error ()
+{
+    int err = errno;
+    return err? err: ENOENT;
+}
+
+namespace detail {
+
+inline void throw_library_error (const char* object)
+{
+    if (const char* msg = ::dlerror())
+	throw generic_error (object, msg);
+    throw generic_error (library_error(), object);
+}
+
+inline void throw_library_error (const WChar* object)
+{
+    string cname;
+    wcstombs (object, cname);
+    throw_library_error (cname.c_str());
+}
+
+} // namespace detail
+
 inline void library::
 close ()
 {
@@ -173,9 +239,10 @@ close ()
     }
 }
 
-inline proc_type library::
-get_proc (const char* symbol)
+inline library::proc_type library::
+get_proc (const char* symbol) const
 {
+    errno = 0;
     return lib? ::dlsym (lib, symbol): 0;
 }
 
@@ -184,15 +251,16 @@ library_throw (const char_type* name)
     : library (name)
 {
     if (!this->lib)
-       	SYS_THROW_GENERIC_ERROR (name, ::dlerror());
+	detail::throw_library_error (name);
 }
 
-inline proc_type library_throw::
-get_proc (const char* symbol)
+inline library_throw::proc_type library_throw::
+get_proc (const char* symbol) const
 {
     proc_type proc = library::get_proc (symbol);
     if (!proc)
-	SYS_THROW_GENERIC_ERROR (symbol, ::dlerror());
+	detail::throw_library_error (symbol);
+    return proc;
 }
 
 #endif
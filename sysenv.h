@@ -140,9 +140,11 @@ bool get_env (const char_type* var, basic_string<char_type>& value)
 
     if (DWORD size = detail::get_env (var, buf.get(), buf.size()))
     {
-	if (size > buf.size())
+	// variable could change between calls, so repeat until it fits
+	while (size > buf.size())
 	{
-	    buf.reserve (size);
+	    buf.clear();
+	    buf.resize (size);
 	    size = detail::get_env (var, buf.get(), size);
 	}
 	if (size)
@@ -169,9 +171,10 @@ bool expand_env (const char_type* src, basic_string<char_type>& dst)
 
     if (DWORD size = detail::expand_env_strings (src, buf.get(), buf.size()))
     {
-	if (size > buf.size())
+	while (size > buf.size())
 	{
-	    buf.reserve (size);
+	    buf.clear();
+	    buf.resize (size);
 	    size = detail::expand_env_strings (src, buf.get(), size);
 	}
 	if (size)
@@ -31,8 +31,13 @@
 #include <exception>
 #include <locale>
 #include <memory>
+#include <mutex>
+#include <new>		// for placement new
+#include <type_traits>	// for std::aligned_storage
+#include <utility>	// for std::move
 #ifdef SYSPP_NO_CPP0X
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #endif
 #ifdef _WIN32
 #include <windows.h>
@@ -44,8 +49,10 @@ namespace sys {
 
 #ifndef SYSPP_NO_CPP0X
 using std::shared_ptr;
+using std::make_shared;
 #else
 using boost::shared_ptr;
+using boost::make_shared;
 #endif
 
 // work-around macros for mingw runtime bug
@@ -65,66 +72,137 @@ using boost::shared_ptr;
 class error_info
 {
 public:
-    error_info () : m_error_code (get_last_error())
-	{ set_system_message(); }
+    // system message is not formatted until it is requested either explicitly or
+    // by what(), so constructing error_info is cheap enough to throw it often.
+    // All the strings are formatted and converted at once, so that error_info
+    // shared by copies of an exception may be queried from several threads.
 
-    explicit error_info (int code) : m_error_code (code)
-	{ set_system_message(); }
+    error_info () : m_error_code (get_last_error()), m_has_system_message (false)
+	{ }
+
+    explicit error_info (int code) : m_error_code (code), m_has_system_message (false)
+	{ }
 
     template <typename CharT>
     explicit error_info (const CharT* object)
 	: m_error_code (get_last_error())
+	, m_has_system_message (false)
+	, m_object (object)
+	{ }
+
+    template <typename CharT>
+    error_info (int code, const CharT* object)
+	: m_error_code (code)
+	, m_has_system_message (false)
 	, m_object (object)
-	{ set_system_message(); }
+	{ }
 
     template <typename Ch, typename Tr, typename Al>
     explicit error_info (const basic_string<Ch,Tr,Al>& object)
 	: m_error_code (get_last_error())
+	, m_has_system_message (false)
 	, m_object (object)
-	{ set_system_message(); }
+	{ }
+
+    template <typename Ch, typename Tr, typename Al>
+    error_info (int code, const basic_string<Ch,Tr,Al>& object)
+	: m_error_code (code)
+	, m_has_system_message (false)
+	, m_object (object)
+	{ }
 
     template <typename CharT>
     error_info (const CharT* object, const CharT* message)
 	: m_error_code (get_last_error())
+	, m_has_system_message (false)
+	, m_custom_message (message)
+	, m_object (object)
+	{ }
+
+    template <typename CharT>
+    error_info (int code, const CharT* object, const CharT* message)
+	: m_error_code (code)
+	, m_has_system_message (false)
 	, m_custom_message (message)
 	, m_object (object)
-	{ set_system_message(); }
+	{ }
 
     template <typename Ch, typename Tr, typename Al>
     explicit error_info (const basic_string<Ch,Tr,Al>& object,
 			 const basic_string<Ch,Tr,Al>& message)
 	: m_error_code (get_last_error())
+	, m_has_system_message (false)
 	, m_custom_message (message)
 	, m_object (object)
-	{ set_system_message(); }
+	{ }
+
+    template <typename Ch, typename Tr, typename Al>
+    error_info (int code, const basic_string<Ch,Tr,Al>& object,
+		const basic_string<Ch,Tr,Al>& message)
+	: m_error_code (code)
+	, m_has_system_message (false)
+	, m_custom_message (message)
+	, m_object (object)
+	{ }
 
     static int get_last_error();
 
     template <typename CharT>
     const CharT* what ()
 	{
-	    if (m_what.empty())
-		make_what<CharT>();
+	    format_once();
 	    return m_what.get_string<CharT>().c_str();
 	}
 
     int get_error_code () const { return m_error_code; }
-    uni_string& get_object () { return m_object; }
-    uni_string& get_system_message () { return m_system_message; }
-    uni_string& get_custom_message () { return m_custom_message; }
+    uni_string& get_object () { format_once(); return m_object; }
+    uni_string& get_custom_message () { format_once(); return m_custom_message; }
+    uni_string& get_system_message () { format_once(); return m_system_message; }
 
 private:
+    error_info (const error_info&);		// not defined
+    error_info& operator= (const error_info&);	// not defined
+
     SYSPP_DLLIMPORT void set_system_message();
 
+    void format_once () { std::call_once (m_formatted, &error_info::format, this); }
+
+    // format ()
+    // Effects: formats the description and converts every string both ways,
+    //          so that accessors only read them afterwards.
+
+    void format ()
+	{
+	    make_what<char>();
+	    uni_string* strings[] = { &m_object, &m_custom_message, &m_system_message, &m_what };
+	    for (size_t i = 0; i < sizeof(strings)/sizeof(*strings); ++i)
+	    {
+		strings[i]->get_string<char>();
+		strings[i]->get_string<WChar>();
+	    }
+	}
+
+    uni_string& system_message ()
+	{
+	    if (!m_has_system_message)
+	    {
+		set_system_message();
+		m_has_system_message = true;
+	    }
+	    return m_system_message;
+	}
+
     template <typename CharT>
     void make_what ();
 
 private:
     int			m_error_code;
+    bool		m_has_system_message;
     uni_string		m_system_message;
     uni_string		m_custom_message;
     uni_string		m_object;
     uni_string		m_what;
+    std::once_flag	m_formatted;
 };
 
 class error_sentry
@@ -144,59 +222,120 @@ private:
     int		m_errno;
 };
 
+/// \class generic_error
+/// \brief base class for system exceptions.
+///
+/// generic_error captures only the error code at construction time.  error_info
+/// is allocated when object name or custom message is supplied, or later, when
+/// error description is first requested; system message is formatted on demand.
+/// Lazily allocated error_info is published atomically, so copies of the
+/// exception may be queried from several threads.
+
 class generic_error : public std::exception
 {
 public:
-    generic_error () : m_info (new error_info) { }
+    generic_error () : m_error_code (error_info::get_last_error()) { }
+
+    explicit generic_error (int errnum) : m_error_code (errnum) { }
 
-    explicit generic_error (int errnum) : m_info (new error_info (errnum)) { }
+    generic_error (const generic_error& other)
+	: std::exception (other)
+	, m_error_code (other.m_error_code)
+	, m_info (atomic_load (&other.m_info))
+	{ }
+
+    generic_error& operator= (const generic_error& other)
+	{
+	    m_error_code = other.m_error_code;
+	    atomic_store (&m_info, atomic_load (&other.m_info));
+	    return *this;
+	}
 
     template <typename CharT>
-    generic_error (int errnum, const CharT* object) : m_info (new error_info (errnum))
-        { m_info->get_object().assign (object); }
+    generic_error (int errnum, const CharT* object)
+	: m_error_code (errnum)
+	, m_info (make_shared<error_info> (errnum, object))
+	{ }
 
     template <typename CharT>
     explicit generic_error (const CharT* object)
-	: m_info (new error_info (object))
+	: m_error_code (error_info::get_last_error())
+	, m_info (make_shared<error_info> (m_error_code, object))
        	{ }
 
     template <typename Ch, typename Tr, typename Al>
     explicit generic_error (const basic_string<Ch,Tr,Al>& object)
-       	: m_info (new error_info (object)) { }
+	: m_error_code (error_info::get_last_error())
+	, m_info (make_shared<error_info> (m_error_code, object))
+	{ }
 
     template <typename CharT>
     explicit generic_error (const CharT* object, const CharT* message)
-	: m_info (new error_info (object, message)) { }
+	: m_error_code (error_info::get_last_error())
+	, m_info (make_shared<error_info> (m_error_code, object, message))
+	{ }
 
     template <typename Ch, typename Tr, typename Al>
     explicit generic_error (const basic_string<Ch,Tr,Al>& object,
    			    const basic_string<Ch,Tr,Al>& message)
-       	: m_info (new error_info (object, message)) { }
+	: m_error_code (error_info::get_last_error())
+	, m_info (make_shared<error_info> (m_error_code, object, message))
+	{ }
 
     ~generic_error () throw() { }
 
-    const char* what () const throw() { return get_description<char>(); }
+    // what ()
+    // Returns: error description, or generic message if it could not be
+    //          formatted.
+
+    const char* what () const throw()
+	{
+	    try
+	    {
+		return get_description<char>();
+	    }
+	    catch (...)
+	    {
+		return "System error";
+	    }
+	}
 
-    int get_error_code () const { return m_info->get_error_code(); }
+    int get_error_code () const { return m_error_code; }
 
     template <typename CharT>
     const CharT* get_system_message () const
-       	{ return m_info->get_system_message().template get_string<CharT>().c_str(); }
+       	{ return info()->get_system_message().template get_string<CharT>().c_str(); }
 
     template <typename CharT>
     const CharT* get_object () const
-       	{ return m_info->get_object().template get_string<CharT>().c_str(); }
+       	{ return info()->get_object().template get_string<CharT>().c_str(); }
 
     template <typename CharT>
     const CharT* get_message () const
-       	{ return m_info->get_custom_message().template get_string<CharT>().c_str(); }
+       	{ return info()->get_custom_message().template get_string<CharT>().c_str(); }
 
     template <typename CharT>
     const CharT* get_description () const
-	{ return m_info->what<CharT>(); }
+	{ return info()->template what<CharT>(); }
 
 protected:
-    shared_ptr<error_info>	m_info;
+    // info()
+    // Returns: pointer to error_info object, allocating it if necessary.
+    error_info* info () const
+	{
+	    shared_ptr<error_info> info = atomic_load (&m_info);
+	    if (!info)
+	    {
+		shared_ptr<error_info> created = make_shared<error_info> (m_error_code);
+		// on failure, INFO receives the one published by another thread
+		if (atomic_compare_exchange_strong (&m_info, &info, created))
+		    info = created;
+	    }
+	    return info.get();
+	}
+
+    int					m_error_code;
+    mutable shared_ptr<error_info>	m_info;	// accessed atomically
 };
 
 class file_error : public generic_error
@@ -225,6 +364,146 @@ public:
     const CharT* get_filename () const { return get_object<CharT>(); }
 };
 
+// ---------------------------------------------------------------------------
+/// \class error_code
+/// \brief system error code reported by non-throwing functions.
+
+class error_code
+{
+public:
+    explicit error_code (int code) : m_code (code) { }
+
+    // error_code::last()
+    // Returns: error code of the last failed system call.
+    static error_code last () { return error_code (error_info::get_last_error()); }
+
+    int value () const { return m_code; }
+
+private:
+    int		m_code;
+};
+
+// ---------------------------------------------------------------------------
+/// \class result
+/// \brief either a value of type T or a system error code.
+///
+/// Non-throwing counterparts of the library functions (named try_*) return
+/// result<T> instead of throwing sys::generic_error or signalling errors
+/// through errno.
+
+template <typename T>
+class result
+{
+public:
+    typedef T	value_type;
+
+    result (const T& value) : m_error (0), m_has_value (true)
+	{ new (&m_storage) T (value); }
+    result (T&& value) : m_error (0), m_has_value (true)
+	{ new (&m_storage) T (std::move (value)); }
+    result (const error_code& err) : m_error (err.value()), m_has_value (false)
+	{ }
+
+    result (const result& other) : m_error (other.m_error), m_has_value (other.m_has_value)
+	{ if (m_has_value) new (&m_storage) T (*other); }
+    result (result&& other) : m_error (other.m_error), m_has_value (other.m_has_value)
+	{ if (m_has_value) new (&m_storage) T (std::move (*other)); }
+
+    ~result () { m_destroy(); }
+
+    result& operator= (const result& other)
+	{
+	    if (&other != this)
+	    {
+		m_destroy();
+		if (other.m_has_value)
+		    new (&m_storage) T (*other);
+		m_has_value = other.m_has_value;
+		m_error = other.m_error;
+	    }
+	    return *this;
+	}
+    result& operator= (result&& other)
+	{
+	    if (&other != this)
+	    {
+		m_destroy();
+		if (other.m_has_value)
+		    new (&m_storage) T (std::move (*other));
+		m_has_value = other.m_has_value;
+		m_error = other.m_error;
+	    }
+	    return *this;
+	}
+
+    bool has_value () const { return m_has_value; }
+    explicit operator bool () const { return m_has_value; }
+    bool operator! () const { return !m_has_value; }
+
+    // error()
+    // Returns: system error code, meaningful only when has_value() is false.
+    int error () const { return m_error; }
+
+    // value()
+    // Returns: reference to the stored value.
+    // Throws: sys::generic_error if result holds an error.
+    T& value ()
+	{
+	    if (!m_has_value) throw generic_error (m_error);
+	    return **this;
+	}
+    const T& value () const
+	{
+	    if (!m_has_value) throw generic_error (m_error);
+	    return **this;
+	}
+
+    T value_or (const T& default_value) const
+	{ return m_has_value? **this: default_value; }
+
+    T& operator* () { return *reinterpret_cast<T*> (&m_storage); }
+    const T& operator* () const { return *reinterpret_cast<const T*> (&m_storage); }
+    T* operator-> () { return &**this; }
+    const T* operator-> () const { return &**this; }
+
+private:
+    void m_destroy ()
+	{
+	    if (m_has_value)
+	    {
+		(**this).~T();
+		m_has_value = false;
+	    }
+	}
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    int		m_error;
+    bool	m_has_value;
+};
+
+template <>
+class result<void>
+{
+public:
+    typedef void value_type;
+
+    result () : m_error (0), m_has_value (true) { }
+    result (const error_code& err) : m_error (err.value()), m_has_value (false) { }
+
+    bool has_value () const { return m_has_value; }
+    explicit operator bool () const { return m_has_value; }
+    bool operator! () const { return !m_has_value; }
+
+    int error () const { return m_error; }
+
+    void value () const
+	{ if (!m_has_value) throw generic_error (m_error); }
+
+private:
+    int		m_error;
+    bool	m_has_value;
+};
+
 // --- error_info ------------------------------------------------------------
 
 inline int error_info::
@@ -252,7 +531,7 @@ void error_info::make_what ()
 	    what_str += colon;
 	what_str += m_custom_message.get_string<CharT>();
     }
-    if (!m_system_message.empty())
+    if (!system_message().empty())
     {
 	if (!what_str.empty())
 	    what_str += colon;
@@ -25,6 +25,27 @@
 //
 
 #include "sysfs.h"
+#include "sysatomic.h"
+#include "sysuring.h"
+#include <cstring>	// for std::strcmp
+#include <algorithm>	// for std::min
+#include <functional>	// for std::ref
+#include <thread>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>	// for makedev
+#include <sys/ioctl.h>
+#include <linux/fs.h>		// for FS_IOC_FIEMAP
+#include <linux/fiemap.h>
+#endif
+#endif
 
 namespace sys {
 
@@ -56,5 +77,1843 @@ bool wgetcwd (WChar* buf, size_t buf_size)
 
 #endif // _WIN32
 
+// --- path creation ---------------------------------------------------------
+
+namespace {
+
+template <typename CharT>
+inline bool is_separator (CharT c)
+{
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+// strip_separators (PATH)
+// Effects: removes trailing separators, which do not name another directory.
+
+template <typename CharT>
+void strip_separators (std::basic_string<CharT>& path)
+{
+    size_t len = path.size();
+    while (len > 1 && is_separator (path[len-1]))
+	--len;
+    path.resize (len);
+}
+
+/// \class path_cache
+/// \brief set of directories known to exist.
+
+class path_cache
+{
+public:
+    // cache is dropped as a whole when it grows past this size
+    enum { max_size = 4096 };
+
+    bool contains (const std::string& dir)
+	{
+	    std::lock_guard<std::mutex> lock (m_lock);
+	    return m_dirs.count (dir) != 0;
+	}
+
+    void insert (const std::string& dir)
+	{
+	    std::lock_guard<std::mutex> lock (m_lock);
+	    if (m_dirs.size() >= max_size)
+		m_dirs.clear();
+	    m_dirs.insert (dir);
+	}
+
+    void clear ()
+	{
+	    std::lock_guard<std::mutex> lock (m_lock);
+	    m_dirs.clear();
+	}
+
+private:
+    std::mutex				m_lock;
+    std::unordered_set<std::string>	m_dirs;
+};
+
+sys::atomic<bool> path_cache_enabled;
+
+path_cache& known_dirs ()
+{
+    static path_cache cache;
+    return cache;
+}
+
+#ifdef _WIN32
+
+inline DWORD file_attributes (const char* path) { return ::GetFileAttributesA (path); }
+inline DWORD file_attributes (const wchar_t* path) { return ::GetFileAttributesW (path); }
+
+inline BOOL create_directory (const char* path) { return ::CreateDirectoryA (path, 0); }
+inline BOOL create_directory (const wchar_t* path) { return ::CreateDirectoryW (path, 0); }
+
+inline bool not_found (DWORD err)
+{
+    return err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND;
+}
+
+template <typename CharT>
+result<void> make_path (std::basic_string<CharT>& dir)
+{
+    DWORD attr = file_attributes (dir.c_str());
+    if (attr != INVALID_FILE_ATTRIBUTES)
+    {
+	if (!(attr & FILE_ATTRIBUTE_DIRECTORY))
+	    return error_code (ERROR_DIRECTORY);
+	return result<void>();
+    }
+    DWORD err = ::GetLastError();
+    if (!not_found (err))
+	return error_code (err);
+    if (create_directory (dir.c_str()))
+	return result<void>();
+    err = ::GetLastError();
+    if (err == ERROR_ALREADY_EXISTS)
+	return result<void>();
+    if (err != ERROR_PATH_NOT_FOUND)
+	return error_code (err);
+
+    // walk back to the deepest existing directory, remembering ends of the
+    // missing ones
+    std::vector<size_t> missing;
+    size_t end = dir.size();
+    for (;;)
+    {
+	missing.push_back (end);
+	size_t prev = end;
+	while (prev > 0 && !is_separator (dir[prev-1]))
+	    --prev;
+	while (prev > 0 && is_separator (dir[prev-1]))
+	    --prev;
+	if (prev == 0)
+	    break;
+	CharT sep = dir[prev];
+	dir[prev] = 0;
+	attr = file_attributes (dir.c_str());
+	err = ::GetLastError();
+	dir[prev] = sep;
+	// anything but 'not found' ends the walk, e.g. UNC server name that is
+	// not a directory by itself
+	if (attr != INVALID_FILE_ATTRIBUTES || !not_found (err))
+	    break;
+	end = prev;
+    }
+    for (size_t i = missing.size(); i-- > 0; )
+    {
+	end = missing[i];
+	CharT sep = end < dir.size() ? dir[end] : 0;
+	if (sep)
+	    dir[end] = 0;
+	BOOL created = create_directory (dir.c_str());
+	err = ::GetLastError();
+	if (sep)
+	    dir[end] = sep;
+	if (!created && err != ERROR_ALREADY_EXISTS)
+	    return error_code (err);
+    }
+    return result<void>();
+}
+
+#else // _WIN32
+
+#ifdef O_PATH
+const int dir_open_flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+const int dir_open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+
+result<void> make_path (std::string& dir)
+{
+    struct stat st;
+    if (0 == ::stat (dir.c_str(), &st))
+    {
+	if (!S_ISDIR (st.st_mode))
+	    return error_code (ENOTDIR);
+	return result<void>();
+    }
+    if (errno != ENOENT)
+	return error_code::last();
+    if (0 == ::mkdir (dir.c_str(), 0777) || errno == EEXIST)
+	return result<void>();
+    if (errno != ENOENT)
+	return error_code::last();
+
+    // walk back to the deepest existing directory; START is the beginning of
+    // the first missing component
+    size_t start = dir.rfind ('/');
+    start = start == std::string::npos ? 0 : start + 1;
+    file_handle base;
+    int base_fd = AT_FDCWD;
+    while (start > 0)
+    {
+	size_t end = start - 1;
+	while (end > 0 && dir[end-1] == '/')
+	    --end;
+	int fd;
+	if (end == 0)
+	    fd = ::open ("/", dir_open_flags);
+	else
+	{
+	    dir[end] = '\0';
+	    fd = ::open (dir.c_str(), dir_open_flags);
+	    dir[end] = '/';
+	}
+	if (fd != -1)
+	{
+	    base.reset (fd);
+	    base_fd = fd;
+	    break;
+	}
+	if (errno != ENOENT)
+	    return error_code::last();
+	start = dir.rfind ('/', end - 1);
+	start = start == std::string::npos ? 0 : start + 1;
+    }
+
+    // create the rest relative to it
+    for (size_t pos = start; pos < dir.size(); )
+    {
+	size_t end = dir.find ('/', pos);
+	bool last = end == std::string::npos;
+	if (last)
+	    end = dir.size();
+	else
+	    dir[end] = '\0';
+	const char* name = dir.c_str() + pos;
+	if (-1 == ::mkdirat (base_fd, name, 0777))
+	{
+	    if (errno != EEXIST)
+		return error_code::last();
+	    if (last && (-1 == ::fstatat (base_fd, name, &st, 0) || !S_ISDIR (st.st_mode)))
+		return error_code (ENOTDIR);
+	}
+	if (!last)
+	{
+	    int fd = ::openat (base_fd, name, dir_open_flags);
+	    if (fd == -1)
+		return error_code::last();
+	    base.reset (fd);
+	    base_fd = fd;
+	    dir[end] = '/';
+	}
+	pos = end;
+	while (pos < dir.size() && dir[pos] == '/')
+	    ++pos;
+    }
+    return result<void>();
+}
+
+#endif // _WIN32
+
+} // anonymous namespace
+
+result<void>
+try_create_path (const char* path)
+{
+    std::string dir (path);
+    strip_separators (dir);
+    if (dir.empty())
+	return result<void>();
+    const bool use_cache = path_cache_enabled.load (memory_order_relaxed);
+    if (use_cache && known_dirs().contains (dir))
+	return result<void>();
+    result<void> rc = make_path (dir);
+    if (rc && use_cache)
+	known_dirs().insert (dir);
+    return rc;
+}
+
+#ifdef _WIN32
+result<void>
+try_create_path (const wchar_t* path)
+{
+    std::wstring dir (path);
+    strip_separators (dir);
+    if (dir.empty())
+	return result<void>();
+    return make_path (dir);
+}
+#endif
+
+void
+set_path_cache (bool enable)
+{
+    path_cache_enabled.store (enable, memory_order_relaxed);
+    if (!enable)
+	known_dirs().clear();
+}
+
+void
+clear_path_cache ()
+{
+    known_dirs().clear();
+}
+
+// --- directory iteration ---------------------------------------------------
+
+namespace detail {
+
+#ifndef _WIN32
+
+static file::type_t from_stat_mode (mode_t mode)
+{
+    return S_ISREG (mode) ? file::regular_file
+	 : S_ISDIR (mode) ? file::directory_file
+	 : S_ISLNK (mode) ? file::symlink_file
+	 : S_ISBLK (mode) ? file::block_file
+	 : S_ISCHR (mode) ? file::character_file
+	 : S_ISFIFO (mode) ? file::fifo_file
+	 : S_ISSOCK (mode) ? file::socket_file
+	 : file::unknown_type;
+}
+
+#endif
+
+#if defined(__linux__)
+
+// layout of the record returned by getdents64
+struct linux_dirent64
+{
+    bin::uint64_t	d_ino;
+    bin::int64_t	d_off;
+    unsigned short	d_reclen;
+    unsigned char	d_type;
+    char		d_name[1];
+};
+
+#endif
+
+struct dir_stream : public refcount_base
+{
+    dir_entry		entry;
+#if defined(_WIN32)
+    HANDLE		find;
+    WIN32_FIND_DATAA	data;
+    bool		pending;	// data holds entry not yet returned
+
+    dir_stream () : find (INVALID_HANDLE_VALUE), pending (false) { }
+    ~dir_stream () { if (find != INVALID_HANDLE_VALUE) ::FindClose (find); }
+#elif defined(__linux__)
+    enum { buffer_size = 32768 };
+
+    file_handle		dir;
+    bool		own;		// dir is closed on destruction
+    char*		buffer;
+    size_t		pos;
+    size_t		end;
+
+    dir_stream () : own (true), buffer (new char[buffer_size]), pos (0), end (0) { }
+    ~dir_stream ()
+	{
+	    if (!own)
+		dir.release();
+	    delete[] buffer;
+	}
+#else
+    DIR*		dirp;
+
+    dir_stream () : dirp (0) { }
+    ~dir_stream () { if (dirp) ::closedir (dirp); }
+#endif
+
+    result<void> open (const char* path);
+#ifndef _WIN32
+    result<void> open (raw_handle handle);
+#endif
+
+    // next ()
+    // Effects: reads next entry into ENTRY.
+    // Returns: false at the end of directory, or system error code.
+    result<bool> next ();
+
+    void set_entry (const char* name, file::type_t type)
+	{
+	    entry.m_name = name;
+	    entry.m_type = type;
+	    entry.m_have_stat = false;
+	}
+
+    static bool is_dots (const char* name)
+	{ return name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])); }
+
+#ifndef _WIN32
+    static file::type_t from_dtype (unsigned char type)
+	{
+	    switch (type)
+	    {
+#ifdef DT_REG
+	    case DT_REG:	return file::regular_file;
+	    case DT_DIR:	return file::directory_file;
+	    case DT_LNK:	return file::symlink_file;
+	    case DT_BLK:	return file::block_file;
+	    case DT_CHR:	return file::character_file;
+	    case DT_FIFO:	return file::fifo_file;
+	    case DT_SOCK:	return file::socket_file;
+#endif
+	    default:		return file::unknown_type;
+	    }
+	}
+#endif
+};
+
+#if defined(_WIN32)
+
+result<void> dir_stream::
+open (const char* path)
+{
+    string pattern (path);
+    if (!pattern.empty() && pattern[pattern.size()-1] != '\\'
+	&& pattern[pattern.size()-1] != '/')
+	pattern += '\\';
+    pattern += '*';
+    find = ::FindFirstFileExA (pattern.c_str(), FindExInfoBasic, &data,
+			       FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+	if (::GetLastError() != ERROR_FILE_NOT_FOUND)
+	    return error_code::last();
+    }
+    else
+	pending = true;
+    return result<void>();
+}
+
+result<bool> dir_stream::
+next ()
+{
+    for (;;)
+    {
+	if (find == INVALID_HANDLE_VALUE)
+	    return false;
+	if (!pending && !::FindNextFileA (find, &data))
+	{
+	    if (::GetLastError() == ERROR_NO_MORE_FILES)
+		return false;
+	    return error_code::last();
+	}
+	pending = false;
+	if (is_dots (data.cFileName))
+	    continue;
+
+	file::type_t type = file::regular_file;
+	if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+	    type = file::symlink_file;
+	else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+	    type = file::directory_file;
+	set_entry (data.cFileName, type);
+
+	LARGE_INTEGER size;
+	size.LowPart = data.nFileSizeLow;
+	size.HighPart = data.nFileSizeHigh;
+	entry.m_size = size.QuadPart;
+	entry.m_mtime = data.ftLastWriteTime;
+	entry.m_have_stat = true;
+	return true;
+    }
+}
+
+#else // _WIN32
+
+result<void> dir_stream::
+open (const char* path)
+{
+    int fd = ::open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+	return error_code::last();
+#ifdef __linux__
+    dir = fd;
+#else
+    dirp = ::fdopendir (fd);
+    if (!dirp)
+    {
+	int err = errno;
+	::close (fd);
+	return error_code (err);
+    }
+#endif
+    entry.m_dir = fd;
+    return result<void>();
+}
+
+result<void> dir_stream::
+open (raw_handle handle)
+{
+#ifdef __linux__
+    // getdents64 continues from the offset shared with the caller
+    if (-1 == ::lseek (handle, 0, SEEK_SET))
+	return error_code::last();
+    dir = handle;
+    own = false;
+    entry.m_dir = handle;
+    return result<void>();
+#else
+    // directory stream takes ownership of the descriptor it reads from
+    int fd = ::dup (handle);
+    if (fd == -1)
+	return error_code::last();
+    dirp = ::fdopendir (fd);
+    if (!dirp)
+    {
+	int err = errno;
+	::close (fd);
+	return error_code (err);
+    }
+    ::rewinddir (dirp);
+    entry.m_dir = fd;
+    return result<void>();
+#endif
+}
+
+result<bool> dir_stream::
+next ()
+{
+#ifdef __linux__
+    for (;;)
+    {
+	if (pos >= end)
+	{
+	    long count = ::syscall (SYS_getdents64, dir.get(), buffer, buffer_size);
+	    if (count < 0)
+		return error_code::last();
+	    if (count == 0)
+		return false;
+	    pos = 0;
+	    end = count;
+	}
+	linux_dirent64* dirent = reinterpret_cast<linux_dirent64*> (buffer + pos);
+	pos += dirent->d_reclen;
+	if (!is_dots (dirent->d_name))
+	{
+	    set_entry (dirent->d_name, from_dtype (dirent->d_type));
+	    return true;
+	}
+    }
+#else
+    for (;;)
+    {
+	errno = 0;
+	struct dirent* dirent = ::readdir (dirp);
+	if (!dirent)
+	{
+	    if (errno)
+		return error_code::last();
+	    return false;
+	}
+	if (!is_dots (dirent->d_name))
+	{
+#ifdef _DIRENT_HAVE_D_TYPE
+	    set_entry (dirent->d_name, from_dtype (dirent->d_type));
+#else
+	    set_entry (dirent->d_name, file::unknown_type);
+#endif
+	    return true;
+	}
+    }
+#endif
+}
+
+#endif // _WIN32
+
+} // namespace detail
+
+result<void> dir_entry::
+m_fetch () const
+{
+#ifndef _WIN32
+    if (!m_have_stat)
+    {
+	struct stat buf;
+	if (-1 == ::fstatat (m_dir, m_name, &buf, AT_SYMLINK_NOFOLLOW))
+	    return error_code::last();
+	m_size = buf.st_size;
+	m_mtime = file::detail::stat_mtime (buf);
+	if (m_type == file::unknown_type)
+	    m_type = detail::from_stat_mode (buf.st_mode);
+	m_have_stat = true;
+    }
+#endif
+    return result<void>();
+}
+
+file::type_t dir_entry::
+m_fetch_type () const
+{
+    m_fetch();
+    return m_type;
+}
+
+result<file::size_type> dir_entry::
+try_size () const
+{
+    result<void> rc = m_fetch();
+    if (!rc)
+	return error_code (rc.error());
+    return m_size;
+}
+
+result<file::time> dir_entry::
+try_mod_time () const
+{
+    result<void> rc = m_fetch();
+    if (!rc)
+	return error_code (rc.error());
+    return file::time (m_mtime);
+}
+
+dir_iterator::
+dir_iterator ()
+{
+}
+
+dir_iterator::
+dir_iterator (const char* path)
+{
+    result<void> rc = try_open (path);
+    if (!rc)
+	throw file_error (rc.error(), path);
+}
+
+dir_iterator::
+dir_iterator (const dir_iterator& other) : m_stream (other.m_stream)
+{
+}
+
+dir_iterator& dir_iterator::
+operator= (const dir_iterator& other)
+{
+    m_stream = other.m_stream;
+    return *this;
+}
+
+dir_iterator::
+~dir_iterator ()
+{
+}
+
+result<void> dir_iterator::
+try_open (const char* path)
+{
+    refcount_ptr<detail::dir_stream> stream (new detail::dir_stream);
+    result<void> rc = stream->open (path);
+    if (!rc)
+	return rc;
+    m_stream = stream;
+    return try_increment();
+}
+
+#ifndef _WIN32
+result<void> dir_iterator::
+try_open (raw_handle dir)
+{
+    refcount_ptr<detail::dir_stream> stream (new detail::dir_stream);
+    result<void> rc = stream->open (dir);
+    if (!rc)
+	return rc;
+    m_stream = stream;
+    return try_increment();
+}
+#endif
+
+const dir_entry& dir_iterator::
+operator* () const
+{
+    return m_stream->entry;
+}
+
+result<void> dir_iterator::
+try_increment ()
+{
+    result<bool> rc = m_stream->next();
+    if (!rc || !*rc)
+	m_stream.reset();
+    if (!rc)
+	return error_code (rc.error());
+    return result<void>();
+}
+
+dir_iterator& dir_iterator::
+operator++ ()
+{
+    result<void> rc = try_increment();
+    if (!rc)
+	throw generic_error (rc.error());
+    return *this;
+}
+
+// --- file status -----------------------------------------------------------
+
+namespace {
+
+#ifdef _WIN32
+
+result<file::status> handle_status (HANDLE handle)
+{
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!::GetFileInformationByHandle (handle, &info))
+	return error_code::last();
+    file::status st;
+    st.mask = file::status_type | file::status_mode | file::status_nlink
+	    | file::status_inode | file::status_size | file::status_mtime
+	    | file::status_btime;
+    st.type = info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT ? file::symlink_file
+	    : info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ? file::directory_file
+	    : file::regular_file;
+    st.mode = info.dwFileAttributes;
+    st.nlink = info.nNumberOfLinks;
+    st.inode = (bin::uint64_t (info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    st.device = info.dwVolumeSerialNumber;
+    LARGE_INTEGER size;
+    size.LowPart = info.nFileSizeLow;
+    size.HighPart = info.nFileSizeHigh;
+    st.size = size.QuadPart;
+    st.mtime = info.ftLastWriteTime;
+    st.btime = info.ftCreationTime;
+    return st;
+}
+
+inline HANDLE open_for_status (const char* name, DWORD flags)
+{
+    return ::CreateFileA (name, 0, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+			  NULL, OPEN_EXISTING, flags, NULL);
+}
+
+inline HANDLE open_for_status (const wchar_t* name, DWORD flags)
+{
+    return ::CreateFileW (name, 0, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+			  NULL, OPEN_EXISTING, flags, NULL);
+}
+
+template <typename CharT>
+result<file::status> name_status (const CharT* name, bool follow)
+{
+    DWORD flags = FILE_FLAG_BACKUP_SEMANTICS;
+    if (!follow)
+	flags |= FILE_FLAG_OPEN_REPARSE_POINT;
+    file_handle file (open_for_status (name, flags));
+    if (!file)
+	return error_code::last();
+    return handle_status (file);
+}
+
+#else // _WIN32
+
+void fill_status (file::status& st, const struct stat& buf)
+{
+    st.mask = file::status_basic;
+    st.type = detail::from_stat_mode (buf.st_mode);
+    st.mode = buf.st_mode & 07777;
+    st.nlink = buf.st_nlink;
+    st.inode = buf.st_ino;
+    st.device = buf.st_dev;
+    st.size = buf.st_size;
+    st.blocks = buf.st_blocks;
+    st.mtime = file::detail::stat_mtime (buf);
+#ifdef __APPLE__
+    st.ctime = buf.st_ctimespec;
+    st.btime = buf.st_birthtimespec;
+    st.mask |= file::status_btime;
+#else
+    st.ctime = buf.st_ctim;
+#endif
+}
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+
+// set once statx turned out to be unavailable (kernels before 4.11, seccomp
+// filters)
+sys::atomic<bool> no_statx;
+
+unsigned statx_mask (unsigned mask)
+{
+    return (mask & file::status_type   ? STATX_TYPE   : 0)
+	 | (mask & file::status_mode   ? STATX_MODE   : 0)
+	 | (mask & file::status_nlink  ? STATX_NLINK  : 0)
+	 | (mask & file::status_inode  ? STATX_INO    : 0)
+	 | (mask & file::status_size   ? STATX_SIZE   : 0)
+	 | (mask & file::status_blocks ? STATX_BLOCKS : 0)
+	 | (mask & file::status_mtime  ? STATX_MTIME  : 0)
+	 | (mask & file::status_ctime  ? STATX_CTIME  : 0)
+	 | (mask & file::status_btime  ? STATX_BTIME  : 0);
+}
+
+inline file::time to_time (const struct statx_timestamp& ts)
+{
+    struct timespec t;
+    t.tv_sec = ts.tv_sec;
+    t.tv_nsec = ts.tv_nsec;
+    return t;
+}
+
+void fill_status (file::status& st, const struct statx& buf)
+{
+    unsigned got = buf.stx_mask;
+    st.mask = 0;
+    if (got & STATX_TYPE)
+    {
+	st.type = detail::from_stat_mode (buf.stx_mode);
+	st.mask |= file::status_type;
+    }
+    if (got & STATX_MODE)
+    {
+	st.mode = buf.stx_mode & 07777;
+	st.mask |= file::status_mode;
+    }
+    if (got & STATX_NLINK)
+    {
+	st.nlink = buf.stx_nlink;
+	st.mask |= file::status_nlink;
+    }
+    if (got & STATX_INO)
+    {
+	st.inode = buf.stx_ino;
+	st.device = makedev (buf.stx_dev_major, buf.stx_dev_minor);
+	st.mask |= file::status_inode;
+    }
+    if (got & STATX_SIZE)
+    {
+	st.size = buf.stx_size;
+	st.mask |= file::status_size;
+    }
+    if (got & STATX_BLOCKS)
+    {
+	st.blocks = buf.stx_blocks;
+	st.mask |= file::status_blocks;
+    }
+    if (got & STATX_MTIME)
+    {
+	st.mtime = to_time (buf.stx_mtime);
+	st.mask |= file::status_mtime;
+    }
+    if (got & STATX_CTIME)
+    {
+	st.ctime = to_time (buf.stx_ctime);
+	st.mask |= file::status_ctime;
+    }
+    if (got & STATX_BTIME)
+    {
+	st.btime = to_time (buf.stx_btime);
+	st.mask |= file::status_btime;
+    }
+}
+
+#endif // STATX_BASIC_STATS
+
+// status of the file NAME relative to directory DIR, FLAGS are AT_* flags
+// accepted by both statx and fstatat.
+
+result<file::status> status_at (int dir, const char* name, int flags, unsigned mask)
+{
+    file::status st;
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    if (!no_statx.load (memory_order_relaxed))
+    {
+	struct statx buf;
+	if (0 == ::statx (dir, name, flags | AT_STATX_SYNC_AS_STAT, statx_mask (mask), &buf))
+	{
+	    fill_status (st, buf);
+	    return st;
+	}
+	if (errno != ENOSYS)
+	    return error_code::last();
+	no_statx.store (true, memory_order_relaxed);
+    }
+#endif
+    struct stat buf;
+    if (-1 == ::fstatat (dir, name, &buf, flags))
+	return error_code::last();
+    fill_status (st, buf);
+    return st;
+}
+
+#endif // _WIN32
+
+} // anonymous namespace
+
+namespace file {
+
+#ifdef _WIN32
+
+result<status>
+try_get_status (sys::raw_handle handle, unsigned)
+{
+    return handle_status (handle);
+}
+
+result<status>
+try_get_status (const char* name, unsigned, bool follow)
+{
+    return name_status (name, follow);
+}
+
+result<status>
+try_get_status (const wchar_t* name, unsigned, bool follow)
+{
+    return name_status (name, follow);
+}
+
+#else // _WIN32
+
+result<status>
+try_get_status (sys::raw_handle handle, unsigned mask)
+{
+#if defined(__linux__) && defined(AT_EMPTY_PATH)
+    return status_at (handle, "", AT_EMPTY_PATH, mask);
+#else
+    struct stat buf;
+    if (-1 == ::fstat (handle, &buf))
+	return error_code::last();
+    status st;
+    fill_status (st, buf);
+    return st;
+#endif
+}
+
+result<status>
+try_get_status (const char* name, unsigned mask, bool follow)
+{
+    return status_at (AT_FDCWD, name, follow ? 0 : AT_SYMLINK_NOFOLLOW, mask);
+}
+
+#endif // _WIN32
+
+} // namespace file
+
+// --- bulk status queries ---------------------------------------------------
+
+namespace {
+
+enum {
+    stat_sync_limit	= 16,	// smaller requests are served synchronously
+    stat_chunk		= 64,	// files taken by a pool thread at once
+    stat_ring_depth	= 256,
+};
+
+// number of threads serving the requests; metadata queries mostly wait for
+// the device, so there are several threads per cpu
+
+unsigned stat_workers ()
+{
+    return std::min (std::max (std::thread::hardware_concurrency(), 1u) * 4, 32u);
+}
+
+void stat_range (const char* const* names, size_t count, file::status* statuses,
+		 int* errors, unsigned mask, bool follow, sys::atomic<size_t>& next)
+{
+    for (;;)
+    {
+	size_t begin = next.fetch_add (stat_chunk, memory_order_relaxed);
+	if (begin >= count)
+	    break;
+	size_t end = std::min<size_t> (begin + stat_chunk, count);
+	for (size_t i = begin; i < end; ++i)
+	{
+	    result<file::status> st = file::try_get_status (names[i], mask, follow);
+	    if (st)
+	    {
+		statuses[i] = *st;
+		errors[i] = 0;
+	    }
+	    else
+		errors[i] = st.error();
+	}
+    }
+}
+
+void stat_pool (const char* const* names, size_t count, file::status* statuses,
+		   int* errors, unsigned mask, bool follow)
+{
+    size_t threads = std::min<size_t> (stat_workers(), (count + stat_chunk - 1) / stat_chunk);
+
+    sys::atomic<size_t> next (0);
+    std::vector<std::thread> pool;
+    pool.reserve (threads);
+    for (size_t i = 1; i < threads; ++i)
+    {
+	try
+	{
+	    pool.push_back (std::thread (stat_range, names, count, statuses, errors,
+					 mask, follow, std::ref (next)));
+	}
+	catch (...)
+	{
+	    break;	// proceed with threads started so far
+	}
+    }
+    stat_range (names, count, statuses, errors, mask, follow, next);
+    for (size_t i = 0; i < pool.size(); ++i)
+	pool[i].join();
+}
+
+#if SYSPP_HAS_IO_URING && defined(STATX_BASIC_STATS)
+
+// stat_ring (NAMES, COUNT, STATUSES, ERRORS, MASK, FOLLOW)
+// Effects: submits statx requests through io_uring, keeping up to
+//          stat_ring_depth of them in flight.
+// Returns: false if io_uring is not usable; requests that could not be
+//          completed are marked with -1 in ERRORS.
+
+bool stat_ring (const char* const* names, size_t count, file::status* statuses,
+		int* errors, unsigned mask, bool follow)
+{
+    if (no_statx.load (memory_order_relaxed))
+	return false;
+    detail::io_ring ring;
+    if (!ring.open (stat_ring_depth) || !ring.supports (IORING_OP_STATX))
+	return false;
+    // statx is always served by kernel workers; use as many of them as the
+    // thread pool would.  Kernels without the limit bound workers by the
+    // ring depth themselves.
+    result<void> limited = ring.set_max_workers (stat_workers(), 0);
+    if (!limited && limited.error() != EINVAL)
+	return false;
+
+    unsigned depth = ring.entries();
+    struct statx* buffers = new struct statx[depth];
+    std::vector<size_t> slot_index (depth);
+    std::vector<unsigned> free_slots (depth);
+    for (unsigned i = 0; i < depth; ++i)
+	free_slots[i] = depth - 1 - i;
+    std::fill (errors, errors + count, -1);
+
+    int flags = (follow ? 0 : AT_SYMLINK_NOFOLLOW) | AT_STATX_SYNC_AS_STAT;
+    unsigned request_mask = statx_mask (mask);
+    size_t next = 0, in_flight = 0;
+    while (next < count || in_flight)
+    {
+	while (next < count && !free_slots.empty())
+	{
+	    io_uring_sqe* sqe = ring.get_sqe();
+	    if (!sqe)
+		break;
+	    unsigned slot = free_slots.back();
+	    free_slots.pop_back();
+	    slot_index[slot] = next;
+	    sqe->opcode = IORING_OP_STATX;
+	    sqe->fd = AT_FDCWD;
+	    sqe->addr = reinterpret_cast<std::size_t> (names[next]);
+	    sqe->len = request_mask;
+	    sqe->off = reinterpret_cast<std::size_t> (&buffers[slot]);
+	    sqe->statx_flags = flags;
+	    sqe->user_data = slot;
+	    ++next;
+	    ++in_flight;
+	}
+	if (!ring.submit (1))
+	    break;
+	while (const io_uring_cqe* cqe = ring.peek_cqe())
+	{
+	    unsigned slot = static_cast<unsigned> (cqe->user_data);
+	    size_t i = slot_index[slot];
+	    if (cqe->res < 0)
+		errors[i] = -cqe->res;
+	    else
+	    {
+		fill_status (statuses[i], buffers[slot]);
+		errors[i] = 0;
+	    }
+	    ring.cqe_seen();
+	    free_slots.push_back (slot);
+	    --in_flight;
+	}
+    }
+    // on failure, requests still in flight could write into buffers after
+    // the ring is closed, so leave them allocated
+    if (!in_flight)
+	delete[] buffers;
+    return true;
+}
+
+#endif // SYSPP_HAS_IO_URING
+
+} // anonymous namespace
+
+namespace file {
+
+void
+stat_many (const char* const* names, size_t count, status* statuses, int* errors,
+	   unsigned mask, bool follow, stat_method method)
+{
+    if (count >= stat_sync_limit)
+    {
+#if SYSPP_HAS_IO_URING && defined(STATX_BASIC_STATS)
+	if (method == stat_io_uring
+	    && stat_ring (names, count, statuses, errors, mask, follow))
+	{
+	    // complete requests the ring failed to handle
+	    for (size_t i = 0; i < count; ++i)
+	    {
+		if (errors[i] != -1)
+		    continue;
+		result<status> st = try_get_status (names[i], mask, follow);
+		if (st)
+		{
+		    statuses[i] = *st;
+		    errors[i] = 0;
+		}
+		else
+		    errors[i] = st.error();
+	    }
+	    return;
+	}
+#endif
+	stat_pool (names, count, statuses, errors, mask, follow);
+	return;
+    }
+    sys::atomic<size_t> next (0);
+    stat_range (names, count, statuses, errors, mask, follow, next);
+}
+
+} // namespace file
+
+// --- space allocation ------------------------------------------------------
+
+namespace file {
+
+#ifdef _WIN32
+
+result<void>
+try_preallocate (sys::raw_handle handle, size_type offset, size_type length, bool keep_size)
+{
+    result<size_type> size = try_get_size (handle);
+    if (!size)
+	return error_code (size.error());
+    if (offset + length <= *size)
+	return result<void>();		// allocation could only be shrunk here
+    FILE_ALLOCATION_INFO alloc;
+    alloc.AllocationSize.QuadPart = offset + length;
+    if (!::SetFileInformationByHandle (handle, FileAllocationInfo, &alloc, sizeof(alloc)))
+	return error_code::last();
+    if (!keep_size)
+    {
+	FILE_END_OF_FILE_INFO eof;
+	eof.EndOfFile.QuadPart = offset + length;
+	if (!::SetFileInformationByHandle (handle, FileEndOfFileInfo, &eof, sizeof(eof)))
+	    return error_code::last();
+    }
+    return result<void>();
+}
+
+namespace {
+
+result<void> set_zero_data (HANDLE handle, size_type offset, size_type length)
+{
+    FILE_ZERO_DATA_INFORMATION zero;
+    zero.FileOffset.QuadPart = offset;
+    zero.BeyondFinalZero.QuadPart = offset + length;
+    DWORD bytes;
+    if (!::DeviceIoControl (handle, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0, &bytes, NULL))
+	return error_code::last();
+    return result<void>();
+}
+
+} // anonymous namespace
+
+result<void>
+try_punch_hole (sys::raw_handle handle, size_type offset, size_type length)
+{
+    DWORD bytes;
+    if (!::DeviceIoControl (handle, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytes, NULL))
+	return error_code::last();
+    return set_zero_data (handle, offset, length);
+}
+
+result<void>
+try_zero_range (sys::raw_handle handle, size_type offset, size_type length)
+{
+    result<size_type> size = try_get_size (handle);
+    if (!size)
+	return error_code (size.error());
+    if (offset + length > *size)
+    {
+	FILE_END_OF_FILE_INFO eof;
+	eof.EndOfFile.QuadPart = offset + length;
+	if (!::SetFileInformationByHandle (handle, FileEndOfFileInfo, &eof, sizeof(eof)))
+	    return error_code::last();
+    }
+    return set_zero_data (handle, offset, length);
+}
+
+#else // _WIN32
+
+namespace {
+
+// write_zeros (FD, OFFSET, LENGTH)
+// Effects: fills range with zeros by plain writes, for filesystems that lack
+//          both unwritten extents and holes.
+
+result<void> write_zeros (int fd, off_t offset, off_t length)
+{
+    static const char zeros[65536] = { 0 };
+    while (length > 0)
+    {
+	size_t chunk = static_cast<size_t> (std::min<off_t> (length, sizeof(zeros)));
+	ssize_t written = ::pwrite (fd, zeros, chunk, offset);
+	if (written < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    return error_code::last();
+	}
+	offset += written;
+	length -= written;
+    }
+    return result<void>();
+}
+
+// extend_to (FD, SIZE)
+// Effects: extends file to SIZE bytes if it is shorter.
+
+result<void> extend_to (int fd, off_t size)
+{
+    struct stat buf;
+    if (-1 == ::fstat (fd, &buf))
+	return error_code::last();
+    if (buf.st_size < size && -1 == ::ftruncate (fd, size))
+	return error_code::last();
+    return result<void>();
+}
+
+} // anonymous namespace
+
+result<void>
+try_preallocate (sys::raw_handle handle, size_type offset, size_type length, bool keep_size)
+{
+#ifdef __linux__
+    if (0 == ::fallocate (handle, keep_size ? FALLOC_FL_KEEP_SIZE : 0, offset, length))
+	return result<void>();
+    if (errno != EOPNOTSUPP || keep_size)
+	return error_code::last();
+#elif defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, offset + length, 0 };
+    if (-1 == ::fcntl (handle, F_PREALLOCATE, &store))
+    {
+	store.fst_flags = F_ALLOCATEALL;
+	if (-1 == ::fcntl (handle, F_PREALLOCATE, &store))
+	    return error_code::last();
+    }
+    if (keep_size)
+	return result<void>();
+    return extend_to (handle, offset + length);
+#endif
+    if (keep_size)
+	return error_code (EOPNOTSUPP);
+    // posix_fallocate falls back to writing into each block where
+    // filesystem has no native support
+    if (int err = ::posix_fallocate (handle, offset, length))
+	return error_code (err);
+    return result<void>();
+}
+
+result<void>
+try_punch_hole (sys::raw_handle handle, size_type offset, size_type length)
+{
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    if (-1 == ::fallocate (handle, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, offset, length))
+	return error_code::last();
+    return result<void>();
+#elif defined(F_PUNCHHOLE)
+    fpunchhole_t hole = { 0, 0, offset, length };
+    if (-1 == ::fcntl (handle, F_PUNCHHOLE, &hole))
+	return error_code::last();
+    return result<void>();
+#else
+    return error_code (EOPNOTSUPP);
+#endif
+}
+
+result<void>
+try_zero_range (sys::raw_handle handle, size_type offset, size_type length)
+{
+#if defined(__linux__) && defined(FALLOC_FL_ZERO_RANGE)
+    if (0 == ::fallocate (handle, FALLOC_FL_ZERO_RANGE, offset, length))
+	return result<void>();
+    if (errno != EOPNOTSUPP)
+	return error_code::last();
+#endif
+    result<void> rc = try_punch_hole (handle, offset, length);
+    if (!rc)
+    {
+	if (rc.error() != EOPNOTSUPP)
+	    return rc;
+	return write_zeros (handle, offset, length);
+    }
+    return extend_to (handle, offset + length);
+}
+
+#endif // _WIN32
+
+// --- file extents ----------------------------------------------------------
+
+result<bool> extent_reader::
+try_next (extent& ext)
+{
+    if (m_size == invalid_size)
+    {
+	result<size_type> size = try_get_size (m_handle);
+	if (!size)
+	    return error_code (size.error());
+	m_size = *size;
+	m_fetched = m_offset;
+    }
+    if (m_offset >= m_size)
+	return false;
+    for (;;)
+    {
+	while (m_next < m_ranges.size() && m_ranges[m_next].end() <= m_offset)
+	    ++m_next;
+	if (m_next < m_ranges.size() || m_fetched > m_offset)
+	    break;
+	result<void> rc = m_fetch();
+	if (!rc)
+	    return error_code (rc.error());
+    }
+    size_type end = m_fetched;
+    bool hole = true;
+    if (m_next < m_ranges.size())
+    {
+	const extent& range = m_ranges[m_next];
+	if (range.offset > m_offset)
+	    end = range.offset;
+	else
+	{
+	    end = range.end();
+	    hole = false;
+	}
+    }
+    end = std::min (end, m_size);
+    ext = extent (m_offset, end - m_offset, hole);
+    m_offset = end;
+    return true;
+}
+
+#ifdef _WIN32
+
+result<void> extent_reader::
+m_fetch ()
+{
+    enum { batch = 64 };
+    FILE_ALLOCATED_RANGE_BUFFER query, ranges[batch];
+    query.FileOffset.QuadPart = m_offset;
+    query.Length.QuadPart = m_size - m_offset;
+    DWORD bytes = 0;
+    m_ranges.clear();
+    m_next = 0;
+    m_fetched = m_size;
+    if (!::DeviceIoControl (m_handle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+			    ranges, sizeof(ranges), &bytes, NULL))
+    {
+	DWORD err = ::GetLastError();
+	if (err == ERROR_INVALID_FUNCTION || err == ERROR_NOT_SUPPORTED)
+	{
+	    // filesystem without sparse files support
+	    m_ranges.push_back (extent (m_offset, m_size - m_offset, false));
+	    return result<void>();
+	}
+	if (err != ERROR_MORE_DATA)
+	    return error_code (err);
+	if (bytes >= sizeof(ranges[0]))
+	{
+	    const FILE_ALLOCATED_RANGE_BUFFER& last = ranges[bytes / sizeof(ranges[0]) - 1];
+	    m_fetched = last.FileOffset.QuadPart + last.Length.QuadPart;
+	}
+    }
+    for (DWORD i = 0; i < bytes / sizeof(ranges[0]); ++i)
+	m_ranges.push_back (extent (ranges[i].FileOffset.QuadPart, ranges[i].Length.QuadPart, false));
+    return result<void>();
+}
+
+#else // _WIN32
+
+namespace {
+
+/// \class position_guard
+/// \brief restores file position moved by SEEK_DATA/SEEK_HOLE queries.
+
+class position_guard
+{
+public:
+    explicit position_guard (int fd) : m_fd (fd), m_pos (::lseek (fd, 0, SEEK_CUR)) { }
+    ~position_guard () { if (m_pos != -1) ::lseek (m_fd, m_pos, SEEK_SET); }
+
+private:
+    position_guard (const position_guard&);		// not defined
+    position_guard& operator= (const position_guard&);	// not defined
+
+    int		m_fd;
+    off_t	m_pos;
+};
+
+} // anonymous namespace
+
+result<void> extent_reader::
+m_fetch ()
+{
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    if (m_method == extent_fiemap)
+	return m_fetch_fiemap();
+#endif
+    return m_fetch_seek();
+}
+
+result<void> extent_reader::
+m_fetch_seek ()
+{
+    m_ranges.clear();
+    m_next = 0;
+    off_t data = m_offset, hole = m_size;
+#ifdef SEEK_DATA
+    position_guard guard (m_handle);
+    data = ::lseek (m_handle, m_offset, SEEK_DATA);
+    if (data == -1)
+    {
+	if (errno == ENXIO)		// nothing but a hole up to the end of file
+	{
+	    m_fetched = m_size;
+	    return result<void>();
+	}
+	if (errno != EINVAL)
+	    return error_code::last();
+	data = m_offset;		// filesystem does not tell holes apart
+    }
+    else
+    {
+	hole = ::lseek (m_handle, data, SEEK_HOLE);
+	if (hole == -1)
+	{
+	    if (errno != ENXIO)
+		return error_code::last();
+	    hole = m_size;
+	}
+    }
+#endif
+    if (data < hole)
+	m_ranges.push_back (extent (data, hole - data, false));
+    m_fetched = std::max<size_type> (hole, m_offset + 1);
+    return result<void>();
+}
+
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+
+result<void> extent_reader::
+m_fetch_fiemap ()
+{
+    enum { batch = 64 };
+    union {
+	struct fiemap	map;
+	char		buf[sizeof(struct fiemap) + batch * sizeof(struct fiemap_extent)];
+    } query;
+    std::memset (&query.map, 0, sizeof(query.map));
+    query.map.fm_start = m_offset;
+    query.map.fm_length = m_size - m_offset;
+    // delayed allocations and unwritten extents with dirty pages are only
+    // reported correctly after the data is written back
+    query.map.fm_flags = FIEMAP_FLAG_SYNC;
+    query.map.fm_extent_count = batch;
+    if (-1 == ::ioctl (m_handle, FS_IOC_FIEMAP, &query.map))
+    {
+	if (errno != EOPNOTSUPP && errno != ENOTTY)
+	    return error_code::last();
+	m_method = extent_seek;
+	return m_fetch_seek();
+    }
+    m_ranges.clear();
+    m_next = 0;
+    m_fetched = m_size;
+    const struct fiemap_extent* extents = query.map.fm_extents;
+    unsigned count = query.map.fm_mapped_extents;
+    if (count == batch && !(extents[count-1].fe_flags & FIEMAP_EXTENT_LAST))
+	m_fetched = extents[count-1].fe_logical + extents[count-1].fe_length;
+    for (unsigned i = 0; i < count; ++i)
+    {
+	// unwritten extents read as zeros
+	if (extents[i].fe_flags & FIEMAP_EXTENT_UNWRITTEN)
+	    continue;
+	size_type offset = extents[i].fe_logical;
+	size_type length = extents[i].fe_length;
+	if (!m_ranges.empty() && m_ranges.back().end() == offset)
+	    m_ranges.back().length += length;
+	else
+	    m_ranges.push_back (extent (offset, length, false));
+    }
+    return result<void>();
+}
+
+#endif
+
+#endif // _WIN32
+
+} // namespace file
+
+// --- byte-range locks ------------------------------------------------------
+
+namespace file {
+
+#ifdef _WIN32
+
+namespace {
+
+void set_range (OVERLAPPED& ov, size_type offset, size_type length,
+		DWORD& length_low, DWORD& length_high)
+{
+    std::memset (&ov, 0, sizeof(ov));
+    ov.Offset = static_cast<DWORD> (offset);
+    ov.OffsetHigh = static_cast<DWORD> (offset >> 32);
+    if (!length)
+    {
+	length_low = length_high = MAXDWORD;
+	return;
+    }
+    length_low = static_cast<DWORD> (length);
+    length_high = static_cast<DWORD> (length >> 32);
+}
+
+} // anonymous namespace
+
+result<bool>
+try_lock (sys::raw_handle handle, lock_mode mode, size_type offset, size_type length, bool wait)
+{
+    OVERLAPPED ov;
+    DWORD low, high;
+    set_range (ov, offset, length, low, high);
+    DWORD flags = (mode == lock_exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0)
+		| (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    if (!::LockFileEx (handle, flags, 0, low, high, &ov))
+    {
+	DWORD err = ::GetLastError();
+	if (err == ERROR_LOCK_VIOLATION && !wait)
+	    return false;
+	return error_code (err);
+    }
+    return true;
+}
+
+result<void>
+try_unlock (sys::raw_handle handle, size_type offset, size_type length)
+{
+    OVERLAPPED ov;
+    DWORD low, high;
+    set_range (ov, offset, length, low, high);
+    if (!::UnlockFileEx (handle, 0, low, high, &ov))
+	return error_code::last();
+    return result<void>();
+}
+
+#else // _WIN32
+
+namespace {
+
+#ifdef F_OFD_SETLK
+// set when kernel predates open file description locks (Linux 3.15)
+sys::atomic<bool> no_ofd_locks;
+#endif
+
+// process locks are not substituted for missing open file description locks:
+// they do not conflict within the process and are released by closing any
+// descriptor of the file.
+
+int set_lock (int fd, short type, size_type offset, size_type length, bool wait)
+{
+#ifdef F_OFD_SETLK
+    struct flock lock;
+    std::memset (&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = offset;
+    lock.l_len = length;
+    int rc = -1;
+    if (!no_ofd_locks.load (memory_order_relaxed))
+    {
+	while (-1 == (rc = ::fcntl (fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock))
+	       && errno == EINTR)
+	    ;
+	// EINVAL could also mean invalid range, which F_GETLK reports as well
+	if (rc != -1 || errno != EINVAL)
+	    return rc;
+	struct flock probe = lock;
+	probe.l_type = F_RDLCK;
+	if (-1 == ::fcntl (fd, F_GETLK, &probe))
+	    return -1;
+	no_ofd_locks.store (true, memory_order_relaxed);
+    }
+#endif
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+} // anonymous namespace
+
+result<bool>
+try_lock (sys::raw_handle handle, lock_mode mode, size_type offset, size_type length, bool wait)
+{
+    if (-1 == set_lock (handle, mode == lock_exclusive ? F_WRLCK : F_RDLCK, offset, length, wait))
+    {
+	if (!wait && (errno == EAGAIN || errno == EACCES))
+	    return false;
+	return error_code::last();
+    }
+    return true;
+}
+
+result<void>
+try_unlock (sys::raw_handle handle, size_type offset, size_type length)
+{
+    if (-1 == set_lock (handle, F_UNLCK, offset, length, false))
+	return error_code::last();
+    return result<void>();
+}
+
+#endif // _WIN32
+
+} // namespace file
+
+// --- directory-relative operations -----------------------------------------
+
+namespace {
+
+bool is_absolute (const char* name)
+{
+#ifdef _WIN32
+    return name[0] == '\\' || name[0] == '/' || (name[0] && name[1] == ':');
+#else
+    return name[0] == '/';
+#endif
+}
+
+string join_path (const string& dir, const char* name)
+{
+    if (dir.empty() || is_absolute (name))
+	return name;
+    string path (dir);
+    char last = path[path.size()-1];
+#ifdef _WIN32
+    if (last != '\\' && last != '/')
+	path += '\\';
+#else
+    if (last != '/')
+	path += '/';
+#endif
+    path += name;
+    return path;
+}
+
+} // anonymous namespace
+
+directory::
+directory ()
+{
+}
+
+directory::
+directory (const char* path)
+{
+    result<void> rc = try_open (path);
+    if (!rc)
+	throw file_error (rc.error(), path);
+}
+
+directory::
+directory (const directory& parent, const char* name)
+{
+    result<void> rc = try_open (parent, name);
+    if (!rc)
+	throw file_error (rc.error(), join_path (parent.m_path, name).c_str());
+}
+
+directory::
+~directory ()
+{
+}
+
+void directory::
+close ()
+{
+    m_handle.close();
+    m_path.clear();
+}
+
+#ifdef _WIN32
+
+string directory::
+m_at (const char* name) const
+{
+    return join_path (m_path, name);
+}
+
+result<void> directory::
+try_open (const char* path)
+{
+    file_handle dir (::CreateFileA (path, 0, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+				    NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL));
+    if (!dir)
+	return error_code::last();
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!::GetFileInformationByHandle (dir, &info))
+	return error_code::last();
+    if (!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+	return error_code (ERROR_DIRECTORY);
+    m_handle = dir;
+    m_path = path;
+    return result<void>();
+}
+
+result<void> directory::
+try_open (const directory& parent, const char* name)
+{
+    return try_open (parent.m_at (name).c_str());
+}
+
+result<raw_handle> directory::
+try_open_at (const char* name, io::sys_mode mode, io::win_sharemode share) const
+{
+    return try_create_file (m_at (name).c_str(), mode, share);
+}
+
+result<file::status> directory::
+try_stat_at (const char* name, bool follow, unsigned mask) const
+{
+    return file::try_get_status (m_at (name).c_str(), mask, follow);
+}
+
+bool directory::
+exists_at (const char* name) const
+{
+    return ::GetFileAttributesA (m_at (name).c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+result<void> directory::
+try_mkdir_at (const char* name) const
+{
+    if (!::CreateDirectoryA (m_at (name).c_str(), 0))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_rmdir_at (const char* name) const
+{
+    if (!::RemoveDirectoryA (m_at (name).c_str()))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_unlink_at (const char* name) const
+{
+    if (!::DeleteFileA (m_at (name).c_str()))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_rename_at (const char* oldname, const directory& newdir, const char* newname,
+	       rename_flags flags) const
+{
+    if (flags & rename_exchange)
+	return error_code (ERROR_NOT_SUPPORTED);
+    DWORD move_flags = flags & rename_noreplace ? 0 : MOVEFILE_REPLACE_EXISTING;
+    if (!::MoveFileExA (m_at (oldname).c_str(), newdir.m_at (newname).c_str(), move_flags))
+	return error_code::last();
+    return result<void>();
+}
+
+#else // _WIN32
+
+result<void> directory::
+try_open (const char* path)
+{
+    int fd = ::open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+	return error_code::last();
+    m_handle = fd;
+    m_path = path;
+    return result<void>();
+}
+
+result<void> directory::
+try_open (const directory& parent, const char* name)
+{
+    int fd = ::openat (parent.handle(), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+	return error_code::last();
+    m_handle = fd;
+    m_path = join_path (parent.m_path, name);
+    return result<void>();
+}
+
+result<raw_handle> directory::
+try_open_at (const char* name, io::sys_mode mode, io::win_sharemode share) const
+{
+    int fd = io::open_share_mode (m_handle.get(), name, mode, share);
+    if (fd == -1)
+	return error_code::last();
+    return fd;
+}
+
+result<file::status> directory::
+try_stat_at (const char* name, bool follow, unsigned mask) const
+{
+    return status_at (m_handle.get(), name, follow ? 0 : AT_SYMLINK_NOFOLLOW, mask);
+}
+
+bool directory::
+exists_at (const char* name) const
+{
+    struct stat buf;
+    return !(-1 == ::fstatat (m_handle.get(), name, &buf, 0) && errno == ENOENT);
+}
+
+result<void> directory::
+try_mkdir_at (const char* name) const
+{
+    if (-1 == ::mkdirat (m_handle.get(), name, 0777))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_rmdir_at (const char* name) const
+{
+    if (-1 == ::unlinkat (m_handle.get(), name, AT_REMOVEDIR))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_unlink_at (const char* name) const
+{
+    if (-1 == ::unlinkat (m_handle.get(), name, 0))
+	return error_code::last();
+    return result<void>();
+}
+
+result<void> directory::
+try_rename_at (const char* oldname, const directory& newdir, const char* newname,
+	       rename_flags flags) const
+{
+    if (flags != rename_replace)
+    {
+#if defined(__linux__) && defined(SYS_renameat2)
+	// rename_flags values match RENAME_NOREPLACE and RENAME_EXCHANGE
+	if (-1 == ::syscall (SYS_renameat2, m_handle.get(), oldname,
+			     newdir.m_handle.get(), newname, unsigned (flags)))
+	    return error_code::last();
+	return result<void>();
+#else
+	return error_code (ENOSYS);
+#endif
+    }
+    if (-1 == ::renameat (m_handle.get(), oldname, newdir.m_handle.get(), newname))
+	return error_code::last();
+    return result<void>();
+}
+
+#endif // _WIN32
+
 } // namespace sys
 
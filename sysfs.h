@@ -30,6 +30,11 @@
 #include "syserror.h"
 #include "sysstring.h"
 #include "syshandle.h"
+#include "refcount_ptr.h"
+#include "sysio.h"	// for sys::io::sys_mode
+#include <iterator>	// for std::input_iterator_tag
+#include <vector>
+#include <ctime>	// for std::time_t
 
 #ifdef _WIN32
 #include <windows.h>
@@ -172,13 +177,44 @@ inline bool getcwd (WChar* buf, size_t buf_size)
 template <typename char_type>
 bool getcwd (basic_string<char_type>& cwd);
 
+// sys::try_create_path (PATH)
+// Effects: creates all directories within PATH that do not exist yet.  Full
+//          path is tried first, so existing directory costs a single stat
+//          and missing leaf one more mkdir; only then path is walked back to
+//          the deepest existing directory and the rest is created by mkdirat
+//          relative to it (CreateDirectory on Windows).  Directories created
+//          concurrently by someone else are accepted.
+// Returns: system error code, ENOTDIR (ERROR_DIRECTORY on Windows) if PATH
+//          names existing file other than directory.
+
+SYSPP_DLLIMPORT result<void> try_create_path (const char* path);
+
+#ifdef _WIN32
+SYSPP_DLLIMPORT result<void> try_create_path (const wchar_t* path);
+#endif
+
+// sys::set_path_cache (ENABLE)
+// Effects: enables or disables the process-wide cache of directories known to
+//          exist, that makes try_create_path of the path created or seen
+//          before return without any system calls.  Cache is keyed by path
+//          string and is not aware of directories removed or renamed, or of
+//          current directory changes for relative paths; call
+//          clear_path_cache() after such changes.  Disabling clears cache.
+
+SYSPP_DLLIMPORT void set_path_cache (bool enable);
+
+SYSPP_DLLIMPORT void clear_path_cache ();
+
 // sys::create_path (PATH)
 // Effects: create all directories within PATH if they dont already exist.
 // Returns: TRUE if path was successfully created or already existed,
 //          FALSE otherwise.
 
 template <typename char_type>
-bool create_path (const basic_string<char_type>& path);
+inline bool create_path (const basic_string<char_type>& path)
+{
+    return bool (try_create_path (path.c_str()));
+}
 
 #ifndef _WIN32
 template <>
@@ -201,6 +237,17 @@ typedef off_t		size_type;
 
 const size_type invalid_size = size_type (-1);
 
+enum type_t {
+    unknown_type,
+    regular_file,
+    directory_file,
+    symlink_file,
+    block_file,
+    character_file,
+    fifo_file,
+    socket_file,
+};
+
 /// sys::file::exists (FILENAME)
 
 inline bool exists (const char* name)
@@ -297,15 +344,24 @@ inline bool rename (const basic_string<Ch,Tr,Al>& oldname,
 
 // --- file time -------------------------------------------------------------
 
+/// \struct time
+/// \brief file timestamp, with 100ns resolution on Windows and nanosecond
+/// resolution on POSIX systems.
+
 struct time : boost::less_than_comparable<time
 	    , boost::equality_comparable<time> >
 {
 #ifdef _WIN32
-    typedef FILETIME	ftime_type;
+    typedef FILETIME		ftime_type;
 #else
-    typedef time_t	ftime_type;
+    typedef struct timespec	ftime_type;
+#endif
+    time (ftime_type t = ftime_type()) : m_time (t) { }
+#ifndef _WIN32
+    time (std::time_t t) { m_time.tv_sec = t; m_time.tv_nsec = 0; }
 #endif
-    time (ftime_type t) : m_time (t) { }
+
+    ftime_type get () const { return m_time; }
 
     bool operator< (const time& rhs) const { return compare (rhs) < 0; }
     bool operator== (const time& rhs) const { return compare (rhs) == 0; }
@@ -315,7 +371,10 @@ struct time : boost::less_than_comparable<time
 #ifdef _WIN32
 	    return ::CompareFileTime (&m_time, &other.m_time);
 #else
-	    return m_time < other.m_time? -1: m_time > other.m_time? 1: 0;
+	    return m_time.tv_sec < other.m_time.tv_sec? -1
+		 : m_time.tv_sec > other.m_time.tv_sec? 1
+		 : m_time.tv_nsec < other.m_time.tv_nsec? -1
+		 : m_time.tv_nsec > other.m_time.tv_nsec? 1: 0;
 #endif
        	}
 
@@ -323,11 +382,173 @@ private:
     ftime_type		m_time;
 };
 
-// sys::file::get_mod_time
-// Returns: last modification time of file identified by name.
-// Throws: sys::file_error if modification time cannot be accessed.
+#ifndef _WIN32
+namespace detail {
+
+inline time::ftime_type stat_mtime (const struct stat& buf)
+{
+#ifdef __APPLE__
+    return buf.st_mtimespec;
+#else
+    return buf.st_mtim;
+#endif
+}
+
+} // namespace detail
+#endif
+
+// --- file status -----------------------------------------------------------
+
+/// fields of sys::file::status, combined into request masks
+
+enum status_mask {
+    status_type		= 0x0001,
+    status_mode		= 0x0002,
+    status_nlink	= 0x0004,
+    status_inode	= 0x0008,	// inode and device
+    status_size		= 0x0010,
+    status_blocks	= 0x0020,
+    status_mtime	= 0x0040,
+    status_ctime	= 0x0080,
+    status_btime	= 0x0100,
+    status_basic	= 0x00ff,	// fields returned by stat()
+    status_all		= 0x01ff,
+};
+
+/// \struct status
+/// \brief file attributes obtained by a single system call.
+///
+/// Fields that were not requested, or are not supported by the system or
+/// filesystem, are left zero and their bits are clear in mask.  Fields that
+/// come at no extra cost may be filled even if not requested.
+
+struct status
+{
+    unsigned		mask;	// status_mask bits of the valid fields
+    type_t		type;
+    unsigned		mode;	// permission bits on POSIX, attributes on Windows
+    unsigned		nlink;
+    bin::uint64_t	inode;
+    bin::uint64_t	device;
+    size_type		size;
+    size_type		blocks;	// number of 512-byte blocks allocated
+    time		mtime;	// last modification
+    time		ctime;	// last status change
+    time		btime;	// creation
+
+    status () : mask (0), type (unknown_type), mode (0), nlink (0)
+	      , inode (0), device (0), size (0), blocks (0) { }
+};
+
+// sys::file::try_get_status (HANDLE, MASK)
+// sys::file::try_get_status (FILENAME, MASK, FOLLOW)
+// Effects: queries attributes selected by MASK, a combination of status_mask
+//          values, with a single statx call where available (fstatat
+//          otherwise, GetFileInformationByHandle on Windows).  Symbolic links
+//          are followed unless FOLLOW is false.
+// Returns: file attributes, or system error code.
+
+SYSPP_DLLIMPORT result<status>
+try_get_status (sys::raw_handle handle, unsigned mask = status_basic);
+
+SYSPP_DLLIMPORT result<status>
+try_get_status (const char* name, unsigned mask = status_basic, bool follow = true);
+
+#ifdef _WIN32
+SYSPP_DLLIMPORT result<status>
+try_get_status (const wchar_t* name, unsigned mask = status_basic, bool follow = true);
+#else
+inline result<status>
+try_get_status (const wstring& name, unsigned mask = status_basic, bool follow = true)
+{
+    string cname;
+    if (!wcstombs (name, cname))
+	return error_code (EILSEQ);
+    return try_get_status (cname.c_str(), mask, follow);
+}
+#endif
+
+template <typename Ch, typename Tr, typename Al>
+inline result<status>
+try_get_status (const basic_string<Ch,Tr,Al>& name, unsigned mask = status_basic,
+		bool follow = true)
+{
+    return try_get_status (name.c_str(), mask, follow);
+}
+
+// sys::file::get_status (FILENAME, MASK)
+// Returns: attributes of the file FILENAME.
+// Throws: sys::file_error if attributes cannot be accessed.
+
+template <typename CharT>
+inline status get_status (const CharT* name, unsigned mask = status_basic)
+{
+    result<status> st = try_get_status (name, mask);
+    if (!st)
+	throw file_error (st.error(), name);
+    return *st;
+}
+
+template <typename Ch, typename Tr, typename Al>
+inline status get_status (const basic_string<Ch,Tr,Al>& name, unsigned mask = status_basic)
+{
+    return get_status (name.c_str(), mask);
+}
+
+/// methods of sys::file::stat_many
+
+enum stat_method {
+    stat_default,	// currently stat_threads
+    stat_threads,	// pool of threads issuing statx/stat calls
+    stat_io_uring,	// io_uring batches, stat_threads if io_uring is unavailable
+};
+
+// sys::file::stat_many (NAMES, COUNT, STATUSES, ERRORS, MASK, FOLLOW, METHOD)
+// Effects: queries attributes of COUNT files NAMES at once, as if by
+//          try_get_status (NAMES[i], MASK, FOLLOW), storing them into
+//          STATUSES[i] and system error code, or 0 on success, into ERRORS[i].
+//          Queries are spread across a pool of threads, or submitted in
+//          io_uring batches, to keep the device busy.
+// Note: kernels serve io_uring statx by their own worker threads, so the ring
+//       does not beat a thread pool; it saves threads in the process though.
+
+SYSPP_DLLIMPORT void
+stat_many (const char* const* names, size_t count, status* statuses, int* errors,
+	   unsigned mask = status_basic, bool follow = true,
+	   stat_method method = stat_default);
+
+// sys::file::stat_many (NAMES, MASK, FOLLOW, METHOD)
+// Returns: vector of attributes or error codes, one for each of the NAMES.
+
+inline std::vector<result<status> >
+stat_many (const std::vector<string>& names, unsigned mask = status_basic, bool follow = true,
+	   stat_method method = stat_default)
+{
+    std::vector<const char*> cnames (names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+	cnames[i] = names[i].c_str();
+    std::vector<status> statuses (names.size());
+    std::vector<int> errors (names.size());
+    if (!names.empty())
+	stat_many (&cnames[0], names.size(), &statuses[0], &errors[0], mask, follow, method);
+
+    std::vector<result<status> > results;
+    results.reserve (names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+	if (errors[i])
+	    results.push_back (error_code (errors[i]));
+	else
+	    results.push_back (statuses[i]);
+    }
+    return results;
+}
 
-inline time get_mod_time (const char* name)
+// sys::file::try_get_mod_time
+// Returns: last modification time of file identified by name, or system error
+//          code if modification time cannot be accessed.
+
+inline result<time> try_get_mod_time (const char* name)
 {
 #ifdef _WIN32
     WIN32_FILE_ATTRIBUTE_DATA attr;
@@ -336,29 +557,48 @@ inline time get_mod_time (const char* name)
 #else
     struct stat buf;
     if (-1 != ::stat (name, &buf))
-	return time (buf.st_mtime);
+	return time (detail::stat_mtime (buf));
 #endif
-    SYS_THROW_FILE_ERROR (name);
+    return error_code::last();
 }
 
 #ifdef _WIN32
-inline time get_mod_time (const wchar_t* name)
+inline result<time> try_get_mod_time (const wchar_t* name)
 {
     WIN32_FILE_ATTRIBUTE_DATA attr;
-    if (!::GetFileAttributesExW (name, GetFileExInfoStandard, &attr))
-	SYS_THROW_FILE_ERROR (name);
-    return time (attr.ftLastWriteTime);
+    if (::GetFileAttributesExW (name, GetFileExInfoStandard, &attr))
+	return time (attr.ftLastWriteTime);
+    return error_code::last();
 }
 #else
-inline time get_mod_time (const wstring& name)
+inline result<time> try_get_mod_time (const wstring& name)
 {
     string cname;
     if (!wcstombs (name, cname))
-	SYS_THROW_FILE_ERROR (name.c_str());
-    return get_mod_time (cname.c_str());
+	return error_code (EILSEQ);
+    return try_get_mod_time (cname.c_str());
 }
 #endif
 
+template <typename Ch, typename Tr, typename Al>
+inline result<time> try_get_mod_time (const basic_string<Ch,Tr,Al>& name)
+{
+    return try_get_mod_time (name.c_str());
+}
+
+// sys::file::get_mod_time
+// Returns: last modification time of file identified by name.
+// Throws: sys::file_error if modification time cannot be accessed.
+
+template <typename CharT>
+inline time get_mod_time (const CharT* name)
+{
+    result<time> mtime = try_get_mod_time (name);
+    if (!mtime)
+	throw file_error (mtime.error(), name);
+    return *mtime;
+}
+
 template <typename Ch, typename Tr, typename Al>
 inline time get_mod_time (const basic_string<Ch,Tr,Al>& name)
 {
@@ -367,25 +607,25 @@ inline time get_mod_time (const basic_string<Ch,Tr,Al>& name)
 
 // --- file size -------------------------------------------------------------
 
-// sys::file::get_size
-// Returns: size of file identified by either handle or name.  In case of error,
-// sys::file::invalid_size is returned.
+// sys::file::try_get_size
+// Returns: size of file identified by either handle or name, or system error
+//          code if size cannot be obtained.
 
-inline size_type get_size (sys::raw_handle handle)
+inline result<size_type> try_get_size (sys::raw_handle handle)
 {
 #ifdef _WIN32
     LARGE_INTEGER size;
     if (::GetFileSizeEx (handle, &size))
-	return size.QuadPart;
+	return size_type (size.QuadPart);
 #else
     struct stat buf;
     if (-1 != ::fstat (handle, &buf))
-	return buf.st_size;
+	return size_type (buf.st_size);
 #endif
-    return invalid_size;
+    return error_code::last();
 }
 
-inline size_type get_size (const char* name)
+inline result<size_type> try_get_size (const char* name)
 {
 #ifdef _WIN32
     WIN32_FILE_ATTRIBUTE_DATA attr;
@@ -394,18 +634,18 @@ inline size_type get_size (const char* name)
 	LARGE_INTEGER size;
 	size.LowPart = attr.nFileSizeLow;
 	size.HighPart = attr.nFileSizeHigh;
-	return size.QuadPart;
+	return size_type (size.QuadPart);
     }
 #else
     struct stat buf;
     if (-1 != ::stat (name, &buf))
-	return buf.st_size;
+	return size_type (buf.st_size);
 #endif
-    return invalid_size;
+    return error_code::last();
 }
 
 #ifdef _WIN32
-inline size_type get_size (const wchar_t* name)
+inline result<size_type> try_get_size (const wchar_t* name)
 {
     WIN32_FILE_ATTRIBUTE_DATA attr;
     if (::GetFileAttributesExW (name, GetFileExInfoStandard, &attr))
@@ -413,28 +653,488 @@ inline size_type get_size (const wchar_t* name)
 	LARGE_INTEGER size;
 	size.LowPart = attr.nFileSizeLow;
 	size.HighPart = attr.nFileSizeHigh;
-	return size.QuadPart;
+	return size_type (size.QuadPart);
     }
-    return invalid_size;
+    return error_code::last();
 }
 #else
-inline size_type get_size (const wstring& name)
+inline result<size_type> try_get_size (const wstring& name)
 {
     string cname;
-    if (wcstombs (name, cname))
-	return get_size (cname.c_str());
-    return invalid_size;
+    if (!wcstombs (name, cname))
+	return error_code (EILSEQ);
+    return try_get_size (cname.c_str());
 }
 #endif
 
+template <typename Ch, typename Tr, typename Al>
+inline result<size_type> try_get_size (const basic_string<Ch,Tr,Al>& name)
+{
+    return try_get_size (name.c_str());
+}
+
+// sys::file::get_size
+// Returns: size of file identified by either handle or name.  In case of error,
+// sys::file::invalid_size is returned.
+
+inline size_type get_size (sys::raw_handle handle)
+{
+    return try_get_size (handle).value_or (invalid_size);
+}
+
+template <typename CharT>
+inline size_type get_size (const CharT* name)
+{
+    return try_get_size (name).value_or (invalid_size);
+}
+
 template <typename Ch, typename Tr, typename Al>
 inline size_type get_size (const basic_string<Ch,Tr,Al>& name)
 {
-    return get_size (name.c_str());
+    return try_get_size (name.c_str()).value_or (invalid_size);
 }
 
+// --- space allocation ------------------------------------------------------
+
+// sys::file::try_preallocate (HANDLE, OFFSET, LENGTH, KEEP_SIZE)
+// Effects: allocates disk space for LENGTH bytes starting at OFFSET, so that
+//          subsequent writes into this range are laid out contiguously and
+//          cannot fail for lack of space.  Preallocated range reads as zeros.
+//          File size is extended to OFFSET+LENGTH unless KEEP_SIZE is true.
+// Returns: system error code if space could not be allocated.
+// Note: on Windows, only allocation at the end of file is supported.
+
+SYSPP_DLLIMPORT result<void>
+try_preallocate (sys::raw_handle handle, size_type offset, size_type length,
+		 bool keep_size = false);
+
+// sys::file::try_punch_hole (HANDLE, OFFSET, LENGTH)
+// Effects: deallocates disk space for LENGTH bytes starting at OFFSET; range
+//          reads as zeros afterwards, file size is not changed.  On Windows,
+//          file is marked as sparse first.
+// Returns: system error code, e.g. if filesystem does not support holes.
+
+SYSPP_DLLIMPORT result<void>
+try_punch_hole (sys::raw_handle handle, size_type offset, size_type length);
+
+// sys::file::try_zero_range (HANDLE, OFFSET, LENGTH)
+// Effects: makes LENGTH bytes starting at OFFSET read as zeros, by converting
+//          range into preallocated space where possible instead of writing
+//          zeros, or by punching a hole otherwise.  File size is extended to
+//          cover the range.
+// Returns: system error code if range could not be zeroed.
+
+SYSPP_DLLIMPORT result<void>
+try_zero_range (sys::raw_handle handle, size_type offset, size_type length);
+
+inline void preallocate (sys::raw_handle handle, size_type offset, size_type length,
+			 bool keep_size = false)
+{ try_preallocate (handle, offset, length, keep_size).value(); }
+
+inline void punch_hole (sys::raw_handle handle, size_type offset, size_type length)
+{ try_punch_hole (handle, offset, length).value(); }
+
+inline void zero_range (sys::raw_handle handle, size_type offset, size_type length)
+{ try_zero_range (handle, offset, length).value(); }
+
+/// \struct extent
+/// \brief range of the file that either holds data or is a hole.
+
+struct extent
+{
+    size_type	offset;
+    size_type	length;
+    bool	hole;	// range reads as zeros and occupies no data blocks
+
+    extent () : offset (0), length (0), hole (false) { }
+    extent (size_type off, size_type len, bool h) : offset (off), length (len), hole (h) { }
+
+    size_type end () const { return offset + length; }
+};
+
+/// methods of sys::file::extent_reader
+
+enum extent_method {
+    extent_seek,	// SEEK_DATA/SEEK_HOLE, two lseek calls per extent
+    extent_fiemap,	// FS_IOC_FIEMAP, extent_seek if not supported
+};
+
+/// \class extent_reader
+/// \brief sequential reader of data and hole extents of the file.
+///
+/// Extents cover the file from the starting offset up to its end without
+/// gaps; adjacent extents are of different kind unless reported so by the
+/// system.  Filesystems without holes support report a single data extent.
+/// extent_fiemap queries extents in batches and also reports preallocated
+/// but unwritten ranges as holes; it flushes dirty data of the file first.
+/// On Windows, FSCTL_QUERY_ALLOCATED_RANGES is used by both methods.
+/// File position of the handle is preserved.
+
+class SYSPP_DLLIMPORT extent_reader
+{
+public:
+    explicit extent_reader (sys::raw_handle handle, size_type offset = 0,
+			    extent_method method = extent_seek)
+	: m_handle (handle), m_offset (offset), m_size (invalid_size)
+	, m_method (method), m_next (0), m_fetched (0)
+	{ }
+
+    // try_next (EXT)
+    // Effects: stores next extent into EXT.
+    // Returns: false if the end of file is reached, or system error code.
+    result<bool> try_next (extent& ext);
+
+    // next (EXT)
+    // Throws: sys::generic_error if extents could not be obtained.
+    bool next (extent& ext) { return try_next (ext).value(); }
+
+    // offset ()
+    // Returns: offset of the next extent.
+    size_type offset () const { return m_offset; }
+
+private:
+    extent_reader (const extent_reader&);		// not defined
+    extent_reader& operator= (const extent_reader&);	// not defined
+
+    // m_fetch ()
+    // Effects: replaces m_ranges with data ranges at or after m_offset and
+    //          advances m_fetched past them, up to the file size if there are
+    //          no more data ranges.
+    result<void> m_fetch ();
+    result<void> m_fetch_seek ();
+    result<void> m_fetch_fiemap ();
+
+    sys::raw_handle	m_handle;
+    size_type		m_offset;
+    size_type		m_size;
+    extent_method	m_method;
+    std::vector<extent>	m_ranges;	// data ranges sorted by offset
+    size_t		m_next;		// first range not passed yet
+    size_type		m_fetched;	// end of the area covered by m_ranges
+};
+
+// --- byte-range locks ------------------------------------------------------
+
+enum lock_mode {
+    lock_shared,	// could be held by any number of handles at once
+    lock_exclusive,	// conflicts with any other lock over the range
+};
+
+// sys::file::try_lock (HANDLE, MODE, OFFSET, LENGTH, WAIT)
+// Effects: locks LENGTH bytes starting at OFFSET, or everything past OFFSET
+//          if LENGTH is 0.  If WAIT is true, waits until conflicting locks
+//          are released.  Locks belong to the open file rather than to the
+//          process (F_OFD_SETLK open file description locks on POSIX), so
+//          they conflict between separately opened handles of the same
+//          process and are released when the last handle of the open file is
+//          closed.  Where such locks are not available (Linux before 3.15,
+//          systems without F_OFD_SETLK), fails with EOPNOTSUPP rather than
+//          fall back to process locks.  On POSIX,
+//          exclusive lock requires HANDLE open for writing and shared lock
+//          requires HANDLE open for reading, and locking the range held by
+//          the same handle converts its mode.  On Windows, locks are
+//          mandatory and do not replace each other.
+// Returns: true if lock was acquired, false if WAIT is false and conflicting
+//          lock is held, or system error code.
+
+SYSPP_DLLIMPORT result<bool>
+try_lock (sys::raw_handle handle, lock_mode mode, size_type offset = 0,
+	  size_type length = 0, bool wait = false);
+
+// sys::file::try_unlock (HANDLE, OFFSET, LENGTH)
+// Effects: releases locks held by HANDLE over the range.  On Windows, range
+//          should match the locked one exactly.
+
+SYSPP_DLLIMPORT result<void>
+try_unlock (sys::raw_handle handle, size_type offset = 0, size_type length = 0);
+
+/// \class range_lock
+/// \brief byte-range lock released on scope exit.
+
+class range_lock
+{
+public:
+    // range_lock (HANDLE, MODE, OFFSET, LENGTH, WAIT)
+    // Effects: locks the range as sys::file::try_lock; if WAIT is false and
+    //          range is locked by another handle, owns_lock() is false.
+    // Throws: sys::generic_error if lock could not be acquired.
+    range_lock (sys::raw_handle handle, lock_mode mode, size_type offset = 0,
+		size_type length = 0, bool wait = true)
+	: m_handle (handle), m_offset (offset), m_length (length)
+	, m_owns (try_lock (handle, mode, offset, length, wait).value())
+	{ }
+
+    ~range_lock () { unlock(); }
+
+    bool owns_lock () const { return m_owns; }
+
+    void unlock ()
+	{
+	    if (m_owns)
+	    {
+		try_unlock (m_handle, m_offset, m_length);
+		m_owns = false;
+	    }
+	}
+
+private:
+    range_lock (const range_lock&);		// not defined
+    range_lock& operator= (const range_lock&);	// not defined
+
+    sys::raw_handle	m_handle;
+    size_type		m_offset;
+    size_type		m_length;
+    bool		m_owns;
+};
+
 } // namespace file
 
+// --- directory-relative operations -----------------------------------------
+
+/// \class directory
+/// \brief open directory that serves as a base for relative file names.
+///
+/// Names passed to the *_at methods are resolved relative to the directory
+/// descriptor (openat, fstatat, unlinkat, renameat2, mkdirat), so the kernel
+/// walks the directory path only once, when the directory is opened.  Absolute
+/// names are used as is.  On Windows, the directory path is prepended to the
+/// names instead.
+
+class SYSPP_DLLIMPORT directory
+{
+public:
+    enum rename_flags {
+	rename_replace		= 0,	// replace existing target
+	rename_noreplace	= 1,	// fail if target exists
+	rename_exchange		= 2,	// atomically swap source and target
+    };
+
+    // default ctor
+    // Postconditions: !is_open()
+    directory ();
+
+    // directory (PATH)
+    // Throws: sys::file_error if directory PATH could not be opened.
+    explicit directory (const char* path);
+
+    template <typename Tr, typename Al>
+    explicit directory (const basic_string<char,Tr,Al>& path);
+
+    // directory (PARENT, NAME)
+    // Effects: opens subdirectory NAME of the directory PARENT.
+    // Throws: sys::file_error if directory could not be opened.
+    directory (const directory& parent, const char* name);
+
+    ~directory ();
+
+    // try_open (PATH)
+    // Returns: system error code if directory PATH could not be opened.
+    result<void> try_open (const char* path);
+
+    // try_open (PARENT, NAME)
+    // Returns: system error code if subdirectory NAME of the directory PARENT
+    //          could not be opened.
+    result<void> try_open (const directory& parent, const char* name);
+
+    void close ();
+
+    bool is_open () const { return m_handle.valid(); }
+
+    // path ()
+    // Returns: path the directory was opened with.
+    const string& path () const { return m_path; }
+
+    // handle ()
+    // Returns: descriptor of the directory (on Windows, handle opened with
+    //          FILE_FLAG_BACKUP_SEMANTICS).
+    raw_handle handle () const { return m_handle.get(); }
+
+    // try_open_at (NAME, MODE, SHARE)
+    // Returns: handle of the opened file, or system error code.
+    // Note: returned handle should be closed by the caller.
+    result<raw_handle> try_open_at (const char* name, io::sys_mode mode,
+				    io::win_sharemode share = io::share_default) const;
+
+    // open_at (NAME, MODE, SHARE)
+    // Returns: handle of the opened file, or invalid handle, like
+    //          sys::create_file.
+    raw_handle open_at (const char* name, io::sys_mode mode,
+			io::win_sharemode share = io::share_default) const
+	{ return try_open_at (name, mode, share).value_or (file_handle::invalid_handle()); }
+
+    // try_stat_at (NAME, FOLLOW, MASK)
+    // Returns: attributes of the file NAME selected by MASK (see
+    //          sys::file::try_get_status), or system error code.  Symbolic
+    //          links are followed unless FOLLOW is false.
+    result<file::status> try_stat_at (const char* name, bool follow = true,
+				      unsigned mask = file::status_basic) const;
+
+    bool exists_at (const char* name) const;
+
+    result<void> try_mkdir_at (const char* name) const;
+    result<void> try_rmdir_at (const char* name) const;
+    result<void> try_unlink_at (const char* name) const;
+
+    // try_rename_at (OLDNAME, NEWDIR, NEWNAME, FLAGS)
+    // Effects: renames file OLDNAME within this directory into NEWNAME within
+    //          NEWDIR.
+    // Returns: system error code on failure.  rename_exchange and, on systems
+    //          without renameat2, rename_noreplace fail with ENOSYS/EINVAL or
+    //          ERROR_NOT_SUPPORTED.
+    result<void> try_rename_at (const char* oldname, const directory& newdir,
+				const char* newname, rename_flags flags = rename_replace) const;
+
+    result<void> try_rename_at (const char* oldname, const char* newname,
+				rename_flags flags = rename_replace) const
+	{ return try_rename_at (oldname, *this, newname, flags); }
+
+    bool mkdir_at (const char* name) const { return bool (try_mkdir_at (name)); }
+    bool rmdir_at (const char* name) const { return bool (try_rmdir_at (name)); }
+    bool unlink_at (const char* name) const { return bool (try_unlink_at (name)); }
+    bool rename_at (const char* oldname, const char* newname) const
+	{ return bool (try_rename_at (oldname, newname)); }
+
+private:
+    directory (const directory&);		// not defined
+    directory& operator= (const directory&);	// not defined
+
+#ifdef _WIN32
+    // full name of the file NAME within directory
+    string m_at (const char* name) const;
+#endif
+
+    file_handle		m_handle;
+    string		m_path;
+};
+
+template <typename Tr, typename Al>
+directory::
+directory (const basic_string<char,Tr,Al>& path) : directory (path.c_str())
+{
+}
+
+// --- directory iteration ---------------------------------------------------
+
+namespace detail { struct dir_stream; }
+
+/// \class dir_entry
+/// \brief entry of the directory enumerated by dir_iterator.
+///
+/// Type of the entry is usually known from the directory listing itself;
+/// size and modification time are obtained on first request by a single
+/// fstatat call relative to the directory descriptor.  Symbolic links are not
+/// followed.
+
+class SYSPP_DLLIMPORT dir_entry
+{
+public:
+    const char* name () const { return m_name; }
+
+    file::type_t type () const
+	{ return m_type != file::unknown_type ? m_type : m_fetch_type(); }
+
+    bool is_directory () const { return type() == file::directory_file; }
+
+    result<file::size_type> try_size () const;
+    result<file::time> try_mod_time () const;
+
+private:
+    friend struct detail::dir_stream;
+
+    dir_entry () : m_name (""), m_type (file::unknown_type), m_have_stat (false) { }
+    dir_entry (const dir_entry&);		// not defined
+    dir_entry& operator= (const dir_entry&);	// not defined
+
+    file::type_t m_fetch_type () const;
+    result<void> m_fetch () const;
+
+    const char*				m_name;
+    mutable file::type_t		m_type;
+    mutable bool			m_have_stat;
+    mutable file::size_type		m_size;
+    mutable file::time::ftime_type	m_mtime;
+#ifndef _WIN32
+    raw_handle				m_dir;
+#endif
+};
+
+/// \class dir_iterator
+/// \brief input iterator over directory entries.
+///
+/// Entries are read in large batches (getdents64 on Linux, FindFirstFileEx
+/// with large fetch on Windows); '.' and '..' are skipped.  Copies of the
+/// iterator share the same position.  Referenced dir_entry is valid until
+/// the iterator is incremented.
+
+class SYSPP_DLLIMPORT dir_iterator
+{
+public:
+    typedef std::input_iterator_tag	iterator_category;
+    typedef dir_entry			value_type;
+    typedef std::ptrdiff_t		difference_type;
+    typedef const dir_entry*		pointer;
+    typedef const dir_entry&		reference;
+
+    // default ctor
+    // Postconditions: iterator equals to the end of any directory.
+    dir_iterator ();
+
+    // dir_iterator (PATH)
+    // Throws: sys::file_error if directory PATH could not be opened.
+    explicit dir_iterator (const char* path);
+
+    template <typename Tr, typename Al>
+    explicit dir_iterator (const basic_string<char,Tr,Al>& path);
+
+    dir_iterator (const dir_iterator& other);
+    dir_iterator& operator= (const dir_iterator& other);
+    ~dir_iterator ();
+
+    // try_open (PATH)
+    // Effects: starts enumeration of directory PATH.
+    // Returns: system error code if directory could not be opened.
+    result<void> try_open (const char* path);
+
+#ifndef _WIN32
+    // try_open (DIR)
+    // Effects: starts enumeration of directory referred by open handle DIR
+    //          from its beginning, rewinding DIR.  DIR is not closed by
+    //          iterator and should remain open while iteration is in progress.
+    // Returns: system error code if directory could not be read.
+    result<void> try_open (raw_handle dir);
+#endif
+
+    reference operator* () const;
+    pointer operator-> () const { return &**this; }
+
+    // operator++
+    // Throws: sys::generic_error if directory could not be read.
+    dir_iterator& operator++ ();
+
+    // try_increment ()
+    // Effects: advances to the next entry.
+    // Returns: system error code if directory could not be read.
+    result<void> try_increment ();
+
+    bool operator== (const dir_iterator& other) const { return m_stream == other.m_stream; }
+    bool operator!= (const dir_iterator& other) const { return m_stream != other.m_stream; }
+
+private:
+    refcount_ptr<detail::dir_stream>	m_stream;	// null at the end
+};
+
+template <typename Tr, typename Al>
+dir_iterator::
+dir_iterator (const basic_string<char,Tr,Al>& path) : dir_iterator (path.c_str())
+{
+}
+
+/// begin/end allow range-based for loops over directory, e.g.
+///   for (const sys::dir_entry& entry : sys::dir_iterator (path))
+
+inline dir_iterator begin (const dir_iterator& it) { return it; }
+inline dir_iterator end (const dir_iterator&) { return dir_iterator(); }
+
 // --- template functions implementation--------------------------------------
 
 #ifdef _WIN32
@@ -452,10 +1152,15 @@ template <typename char_type>
 bool getcwd (basic_string<char_type>& cwd)
 {
     cwd.clear();
-    size_t req_size = detail::get_curdir (0, (char_type*)0);
-    local_buffer<char_type> buf (req_size);
-    req_size = detail::get_curdir (buf.size(), buf.get());
-    bool success = req_size && req_size < buf.size();
+    local_buffer<char_type> buf;
+    size_t req_size;
+    // directory could change between calls, so repeat until it fits
+    while ((req_size = detail::get_curdir (buf.size(), buf.get())) >= buf.size())
+    {
+	buf.clear();
+	buf.resize (req_size);
+    }
+    bool success = req_size != 0;
     if (success)
 	cwd.assign (buf.get(), req_size);
     return success;
@@ -468,19 +1173,15 @@ inline bool getcwd (basic_string<char>& cwd)
 {
     cwd.clear();
     local_buffer<char> buf;
-    if (getcwd (buf.get(), buf.size()))
+    while (!getcwd (buf.get(), buf.size()))
     {
-	cwd.assign (buf.get());
-	return true;
+	if (errno != ERANGE)
+	    return false;
+	buf.clear();
+	buf.resize (buf.capacity() * 2);
     }
-    if (errno != ERANGE)
-	return false;
-
-    buf.reserve (1024);
-    bool success = getcwd (buf.get(), buf.size());
-    if (success)
-	cwd.assign (buf.get());
-    return success;
+    cwd.assign (buf.get());
+    return true;
 }
 
 template<>
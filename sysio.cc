@@ -31,6 +31,8 @@
 #include <windows.h>
 #else
 #include <cerrno>
+#include <unistd.h>	// for ftruncate, unlinkat
+#include <sys/file.h>	// for flock
 #endif /* _WIN32 */
 
 namespace sys {
@@ -146,7 +148,7 @@ io::ios_to_sys (io::ios_mode ios_mode)
 }
 
 raw_handle
-create_file (const WChar* name, io::sys_mode flags, io::win_sharemode)
+create_file (const WChar* name, io::sys_mode flags, io::win_sharemode share)
 {
     string cname;
     if (!wcstombs (name, cname))
@@ -154,7 +156,81 @@ create_file (const WChar* name, io::sys_mode flags, io::win_sharemode)
 	errno = ENOENT;
 	return file_handle::invalid_handle();
     }
-    return ::open (cname.c_str(), flags, 0666);
+    return create_file (cname.c_str(), flags, share);
+}
+
+bool io::
+lock_share_mode_slow (int fd, io::win_sharemode share)
+{
+    int op = (share & share_read) ? LOCK_SH : LOCK_EX;
+    int rc;
+    while (-1 == (rc = ::flock (fd, op | LOCK_NB)) && errno == EINTR)
+	;
+    if (rc != -1)
+	return true;
+    int err = errno;
+    // flock emulated by fcntl locks (NFS, some FUSE) requires FD opened for
+    // writing to take exclusive lock, or is not supported at all
+    if (err == EBADF || err == ENOLCK || err == EOPNOTSUPP)
+	return true;
+    ::close (fd);
+    errno = err;
+    return false;
+}
+
+int io::
+open_share_mode (int dir, const char* name, io::sys_mode flags, io::win_sharemode share)
+{
+    if ((share & (share_read|share_write)) == (share_read|share_write))
+	return ::openat (dir, name, flags, 0666);
+
+    const int open_flags = flags & ~O_TRUNC;
+    bool created = false;
+    int fd = -1;
+    if ((flags & O_CREAT) && !(flags & O_EXCL))
+    {
+	// tell whether the file is created here.  dangling symbolic link
+	// fails both ways, so it is eventually opened without checking.
+	for (int attempt = 0; attempt < 3 && fd == -1; ++attempt)
+	{
+	    fd = ::openat (dir, name, open_flags | O_EXCL, 0666);
+	    if (fd != -1)
+		created = true;
+	    else if (errno != EEXIST)
+		return -1;
+	    else if (-1 == (fd = ::openat (dir, name, open_flags & ~O_CREAT)) && errno != ENOENT)
+		return -1;
+	}
+	if (fd == -1)
+	    fd = ::openat (dir, name, open_flags, 0666);
+    }
+    else
+    {
+	fd = ::openat (dir, name, open_flags, 0666);
+	created = (flags & O_CREAT) != 0;
+    }
+    if (fd == -1)
+	return -1;
+
+    if (!lock_share_mode_slow (fd, share))
+    {
+	if (created)
+	{
+	    int err = errno;
+	    ::unlinkat (dir, name, 0);
+	    errno = err;
+	}
+	return -1;
+    }
+    if ((flags & O_TRUNC) && !created && (flags & O_ACCMODE) != O_RDONLY
+	&& -1 == ::ftruncate (fd, 0))
+    {
+	int err = errno;
+	::close (fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
 }
 
 #endif /* _WIN32 */
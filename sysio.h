@@ -29,9 +29,15 @@
 
 #include "syshandle.h"
 #include "sysstring.h"
+#include "syserror.h"	// for sys::result
 #include <ios>		// for std::ios
 #include <utility>	// for std::pair
 #include <fcntl.h>	// for POSIX io flags
+#ifdef SYSPP_ENABLE_TIMING
+#include "histogram.hpp"	// for SYSPP_LATENCY_SCOPE
+#elif !defined(SYSPP_LATENCY_SCOPE)
+#define SYSPP_LATENCY_SCOPE(probe)
+#endif
 
 #ifndef _WIN32
 
@@ -56,6 +62,8 @@ namespace sys {
 
 size_t write_file (raw_handle file, const char* buf, size_t size);
 size_t read_file (raw_handle file, char* buf, size_t size);
+result<size_t> try_write_file (raw_handle file, const char* buf, size_t size);
+result<size_t> try_read_file (raw_handle file, char* buf, size_t size);
 std::streamoff seek_file (raw_handle file, std::streamoff off, std::ios::seekdir dir);
 
 namespace io {
@@ -343,6 +351,7 @@ create_file (const WChar* name, io::sys_mode flags, io::win_sharemode share)
 
 inline size_t write_file (raw_handle file, const char* buf, size_t size)
 {
+    SYSPP_LATENCY_SCOPE (probe_write);
     DWORD written;
     ::WriteFile (file, buf, size, &written, 0);
     return written;
@@ -350,11 +359,30 @@ inline size_t write_file (raw_handle file, const char* buf, size_t size)
 
 inline size_t read_file (raw_handle file, char* buf, size_t size)
 {
+    SYSPP_LATENCY_SCOPE (probe_read);
     DWORD read_bytes;
     ::ReadFile (file, buf, size, &read_bytes, 0);
     return read_bytes;
 }
 
+inline result<size_t> try_write_file (raw_handle file, const char* buf, size_t size)
+{
+    SYSPP_LATENCY_SCOPE (probe_write);
+    DWORD written;
+    if (!::WriteFile (file, buf, size, &written, 0))
+	return error_code::last();
+    return size_t (written);
+}
+
+inline result<size_t> try_read_file (raw_handle file, char* buf, size_t size)
+{
+    SYSPP_LATENCY_SCOPE (probe_read);
+    DWORD read_bytes;
+    if (!::ReadFile (file, buf, size, &read_bytes, 0))
+	return error_code::last();
+    return size_t (read_bytes);
+}
+
 inline std::streamoff
 seek_file (raw_handle file, std::streamoff off, std::ios::seekdir dir)
 {
@@ -363,24 +391,83 @@ seek_file (raw_handle file, std::streamoff off, std::ios::seekdir dir)
 
 #else
 
+namespace io {
+
+// lock_share_mode (FD, SHARE)
+// Effects: emulates sharing restrictions of Windows by the whole-file flock,
+//          which belongs to the open file description like the Windows
+//          handle: denying read takes exclusive lock, denying write alone
+//          takes shared lock, share_read|share_write takes none.  Locks are
+//          advisory, so only openers that restrict sharing are checked
+//          against each other; share_delete is ignored.  Where flock is
+//          emulated by fcntl locks (NFS) exclusive lock on FD opened
+//          read-only fails with EBADF; this, ENOLCK and EOPNOTSUPP mean that
+//          locking is not available, and FD is left open without restricting
+//          sharing.  If lock could not be taken otherwise, FD is closed.
+// Returns: false with errno set to EWOULDBLOCK if conflicting lock is held,
+//          or system error code.
+
+SYSPP_DLLIMPORT bool lock_share_mode_slow (int fd, win_sharemode share);
+
+inline bool lock_share_mode (int fd, win_sharemode share)
+{
+    return (share & (share_read|share_write)) == (share_read|share_write)
+	|| lock_share_mode_slow (fd, share);
+}
+
+// open_share_mode (DIR, NAME, FLAGS, SHARE)
+// Effects: opens file NAME relative to directory descriptor DIR (AT_FDCWD
+//          for the current directory) and locks it by lock_share_mode.  Like
+//          CreateFile, leaves the file intact on sharing violation: O_TRUNC
+//          is applied by ftruncate once the lock is taken, and the file
+//          created by this call is removed if it could not be locked.
+// Returns: file descriptor, or -1 with errno set.
+
+SYSPP_DLLIMPORT int open_share_mode (int dir, const char* name, sys_mode flags,
+				     win_sharemode share);
+
+} // namespace io
+
 inline raw_handle
-create_file (const char* name, io::sys_mode flags, io::win_sharemode)
+create_file (const char* name, io::sys_mode flags, io::win_sharemode share)
 {
-    return ::open (name, flags, 0666);
+    if ((share & (io::share_read|io::share_write)) == (io::share_read|io::share_write))
+	return ::open (name, flags, 0666);
+    return io::open_share_mode (AT_FDCWD, name, flags, share);
 }
 
 inline size_t write_file (raw_handle file, const char* buf, size_t size)
 {
+    SYSPP_LATENCY_SCOPE (probe_write);
     int written = ::write (file, buf, size);
     return written > 0? written: 0;
 }
 
 inline size_t read_file (raw_handle file, char* buf, size_t size)
 {
+    SYSPP_LATENCY_SCOPE (probe_read);
     int read_bytes = ::read (file, buf, size);
     return read_bytes > 0? read_bytes: 0;
 }
 
+inline result<size_t> try_write_file (raw_handle file, const char* buf, size_t size)
+{
+    SYSPP_LATENCY_SCOPE (probe_write);
+    ssize_t written = ::write (file, buf, size);
+    if (written < 0)
+	return error_code::last();
+    return size_t (written);
+}
+
+inline result<size_t> try_read_file (raw_handle file, char* buf, size_t size)
+{
+    SYSPP_LATENCY_SCOPE (probe_read);
+    ssize_t read_bytes = ::read (file, buf, size);
+    if (read_bytes < 0)
+	return error_code::last();
+    return size_t (read_bytes);
+}
+
 inline std::streamoff
 seek_file (raw_handle file, std::streamoff offset, std::ios::seekdir dir)
 {
@@ -389,6 +476,37 @@ seek_file (raw_handle file, std::streamoff offset, std::ios::seekdir dir)
 
 #endif
 
+// --- non-throwing i/o ------------------------------------------------------
+//
+// try_* functions report errors by returning sys::result holding system error
+// code instead of collapsing them into 0 or invalid handle.
+
+// try_create_file (FILENAME, MODE, SHARE)
+// Returns: handle of the opened file, or system error code.
+// Note: returned handle should be closed by the caller.
+
+template <typename CharT> inline result<raw_handle>
+try_create_file (const CharT* filename, io::sys_mode mode,
+		 io::win_sharemode share = io::share_default)
+{
+    raw_handle handle = create_file (filename, mode, share);
+    if (!file_handle::valid (handle))
+	return error_code::last();
+    return handle;
+}
+
+// try_seek_file (FILE, OFFSET, DIR)
+// Returns: new file position, or system error code.
+
+inline result<std::streamoff>
+try_seek_file (raw_handle file, std::streamoff offset, std::ios::seekdir dir)
+{
+    std::streamoff pos = seek_file (file, offset, dir);
+    if (pos == std::streamoff (-1))
+	return error_code::last();
+    return pos;
+}
+
 } // namespace sys
 
 #endif /* SYSPP_SYSIO_H */
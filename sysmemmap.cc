@@ -44,14 +44,15 @@ detail::info::info ()
 
 #ifdef _WIN32
 
-void map_base::
-open (sys::raw_handle file, mode_t mode, off_type file_size)
+result<void> map_base::
+try_open (sys::raw_handle file, mode_t mode, off_type file_size)
 {
     if (!file_size)
     {
-	file_size = file::get_size (file);
-	if (file_size == static_cast<off_type> (file::invalid_size))
-            SYS_THROW_SYSTEM_ERROR();
+	result<file::size_type> size = file::try_get_size (file);
+	if (!size)
+	    return error_code (size.error());
+	file_size = *size;
     }
     DWORD protect, map_access;
     switch (mode)
@@ -65,27 +66,36 @@ open (sys::raw_handle file, mode_t mode, off_type file_size)
     sz.QuadPart = file_size;
     sys::handle backend (::CreateFileMapping (file, NULL, protect, sz.HighPart, sz.LowPart, NULL));
     if (!backend)
-        SYS_THROW_SYSTEM_ERROR();
+	return error_code::last();
+    // file handle is retained for extent queries
+    HANDLE file_dup;
+    if (!::DuplicateHandle (::GetCurrentProcess(), file, ::GetCurrentProcess(), &file_dup,
+			    0, FALSE, DUPLICATE_SAME_ACCESS))
+	return error_code::last();
+    sys::file_handle file_backend (file_dup);
 
-    impl.reset (new detail::map_impl (backend, file_size, map_access));
+    impl = make_refcounted<detail::map_impl> (backend, file_backend, file_size, map_access);
+    return result<void>();
 }
 
 #else
 
-void map_base::
-open (sys::raw_handle file, mode_t mode, off_type file_size)
+result<void> map_base::
+try_open (sys::raw_handle file, mode_t mode, off_type file_size)
 {
     if (!file_size)
     {
-	file_size = file::get_size (file);
-	if (file::invalid_size == file_size)
-	    SYS_THROW_SYSTEM_ERROR();
+	result<file::size_type> size = file::try_get_size (file);
+	if (!size)
+	    return error_code (size.error());
+	file_size = *size;
     }
     sys::handle backend (::dup (file));
     if (!backend)
-        SYS_THROW_SYSTEM_ERROR();
+	return error_code::last();
 
-    impl.reset (new detail::map_impl (backend, file_size, mode));
+    impl = make_refcounted<detail::map_impl> (backend, file_size, mode);
+    return result<void>();
 }
 
 #endif /* _WIN32 */
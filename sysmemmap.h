@@ -128,7 +128,19 @@ protected:
 
     template <typename CharT>
     void open (const CharT* filename, mode_t mode, off_type size = 0);
-    void open (sys::raw_handle handle, mode_t mode, off_type size = 0);
+    void open (sys::raw_handle handle, mode_t mode, off_type size = 0)
+	{ try_open (handle, mode, size).value(); }
+
+    /// try_open (FILENAME, MODE, SIZE)
+    /// try_open (HANDLE, MODE, SIZE)
+    ///
+    /// Effects: same as open(), but system errors are reported through returned
+    /// result instead of exception.
+    /// Throws: std::bad_alloc if memory allocation for map failed.
+
+    template <typename CharT>
+    result<void> try_open (const CharT* filename, mode_t mode, off_type size = 0);
+    result<void> try_open (sys::raw_handle handle, mode_t mode, off_type size = 0);
 
 private:
     /// open_mode (MODE)
@@ -179,6 +191,17 @@ public:
 
     void open (sys::raw_handle handle, off_type size = 0)
        	{ map_base::open (handle, read, size); }
+
+    template <typename CharT>
+    result<void> try_open (const CharT* filename, off_type size = 0)
+       	{ return map_base::try_open (filename, read, size); }
+
+    template <typename Ch, typename Tr, typename Al>
+    result<void> try_open (const basic_string<Ch,Tr,Al>& filename, off_type size = 0)
+	{ return map_base::try_open (filename.c_str(), read, size); }
+
+    result<void> try_open (sys::raw_handle handle, off_type size = 0)
+       	{ return map_base::try_open (handle, read, size); }
 };
 
 /// \class sys::mapping::readwrite
@@ -215,6 +238,20 @@ public:
 
     void open (sys::raw_handle handle, write_mode_t mode = writeshare, off_type size = 0)
        	{ map_base::open (handle, mode == writeshare? write: copy, size); }
+
+    template <typename CharT>
+    result<void> try_open (const CharT* filename, write_mode_t mode = writeshare,
+			   off_type size = 0)
+       	{ return map_base::try_open (filename, mode == writeshare? write: copy, size); }
+
+    template <typename Ch, typename Tr, typename Al>
+    result<void> try_open (const basic_string<Ch,Tr,Al>& filename,
+			   write_mode_t mode = writeshare, off_type size = 0)
+	{ return map_base::try_open (filename.c_str(), mode == writeshare? write: copy, size); }
+
+    result<void> try_open (sys::raw_handle handle, write_mode_t mode = writeshare,
+			   off_type size = 0)
+       	{ return map_base::try_open (handle, mode == writeshare? write: copy, size); }
 };
 
 /// \class sys::mapping::map_base::view
@@ -315,10 +352,53 @@ public:
 	    }
 	}
 
+    /// try_remap (MAP, OFFSET, N)
+    /// try_remap (OFFSET, N)
+    ///
+    /// Effects: same as remap(), but errors are reported through returned result
+    /// instead of exception.
+
+    result<void> try_remap (const map_base& mf, off_type offset = 0, size_type n = 0)
+	{
+	    bind (mf);
+	    return try_do_remap (offset, n);
+	}
+    result<void> try_remap (off_type offset, size_type n)
+	{
+	    unmap();
+	    return try_do_remap (offset, n);
+	}
+
     off_type max_offset () const { return map->get_size(); }
 
+    /// file_handle()
+    ///
+    /// Returns: handle of the underlying file, valid while view is bound.
+
+    sys::raw_handle file_handle () const { return map->file(); }
+
+    /// copy_on_write()
+    ///
+    /// Returns: true if view is bound to the private copy-on-write map, whose
+    /// contents could differ from the underlying file.
+
+    bool copy_on_write () const { return map->copy_on_write(); }
+
 private:
     void do_remap (off_type offset, size_type n);
+    result<void> try_do_remap (off_type offset, size_type n);
+
+    // m_valid_offset (OFFSET)
+    // Returns: true if view of at least one T object could be mapped at OFFSET.
+    bool m_valid_offset (off_type offset) const
+	{
+	    const auto map_size = map->get_size();
+	    return !(sizeof(T) > map_size || offset > map_size-sizeof(T));
+	}
+
+    // m_map (OFFSET, N)
+    // Returns: false if system failed to map view.
+    bool m_map (off_type offset, size_type n);
 
     refcount_ptr<detail::map_impl>	map;
     T*		area;	// pointer to the beginning of view address space
@@ -369,19 +449,22 @@ public:
 
 // --- template methods implementation ---------------------------------------
 
-template <typename CharT> inline void map_base::
-open (const CharT* filename, mode_t mode, off_type size)
+template <typename CharT> inline result<void> map_base::
+try_open (const CharT* filename, mode_t mode, off_type size)
 {
     // this handle automatically closes itself on function exit
     sys::file_handle handle (sys::create_file (filename, open_mode (mode), io::share_default));
-    if (!handle) SYS_THROW_FILE_ERROR (filename);
-    try {
-	open (handle, mode, size);
-    }
-    catch (generic_error& X)
-    {
-	throw file_error (X.get_error_code(), filename);
-    }
+    if (!handle)
+	return error_code::last();
+    return try_open (handle, mode, size);
+}
+
+template <typename CharT> inline void map_base::
+open (const CharT* filename, mode_t mode, off_type size)
+{
+    result<void> rc = try_open (filename, mode, size);
+    if (!rc)
+	throw file_error (rc.error(), filename);
 }
 
 template <class T> void map_base::view<T>::
@@ -391,18 +474,39 @@ do_remap (off_type offset, size_type n)
 
     if (!map)
 	throw std::invalid_argument ("map_base::view: taking view of an uninitialized map");
-    const auto map_size = map->get_size();
-    if (sizeof(T) > map_size || offset > map_size-sizeof(T))
+    if (!m_valid_offset (offset))
 	throw std::range_error ("map_base::view: offset exceedes map size");
+    if (!m_map (offset, n))
+	SYS_THROW_SYSTEM_ERROR();
+}
+
+template <class T> result<void> map_base::view<T>::
+try_do_remap (off_type offset, size_type n)
+{
+    assert (0 == area);
+
+    if (!map)
+	return error_code (detail::invalid_map_error);
+    if (!m_valid_offset (offset))
+	return error_code (detail::invalid_offset_error);
+    if (!m_map (offset, n))
+	return error_code::last();
+    return result<void>();
+}
 
+template <class T> bool map_base::view<T>::
+m_map (off_type offset, size_type n)
+{
+    const auto map_size = map->get_size();
     size_type byte_size = n*sizeof(T);
     if (!byte_size || off_type (byte_size) > map_size || offset > map_size-byte_size)
 	byte_size = map_size - offset;
 
     void* v = map->map (offset, byte_size);
-    if (!v) SYS_THROW_SYSTEM_ERROR();
+    if (!v) return false;
     area = static_cast<T*> (v);
     msize = byte_size / sizeof(T);
+    return true;
 }
 
 } // namespace mapping
@@ -432,6 +536,13 @@ public:
     void open (sys::raw_handle handle, mapping::mode_t mode, off_type size = 0)
        	{ map_base::open (handle, mode, size); }
 
+    template <typename CharT>
+    result<void> try_open (const CharT* filename, mapping::mode_t mode, off_type size = 0)
+       	{ return map_base::try_open (filename, mode, size); }
+
+    result<void> try_open (sys::raw_handle handle, mapping::mode_t mode, off_type size = 0)
+       	{ return map_base::try_open (handle, mode, size); }
+
     template <class T>
     class view;
 };
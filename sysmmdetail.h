@@ -30,6 +30,11 @@
 #include "syshandle.h"
 #include "syserror.h"
 #include "refcount_ptr.h"
+#ifdef SYSPP_ENABLE_TIMING
+#include "histogram.hpp"	// for SYSPP_LATENCY_SCOPE
+#elif !defined(SYSPP_LATENCY_SCOPE)
+#define SYSPP_LATENCY_SCOPE(probe)
+#endif
 
 #ifdef _WIN32
 
@@ -54,6 +59,20 @@ enum mode_t
    
 namespace detail {
 
+// error codes reported by non-throwing view methods
+
+#ifdef _WIN32
+enum {
+    invalid_map_error		= ERROR_INVALID_HANDLE,
+    invalid_offset_error	= ERROR_INVALID_PARAMETER,
+};
+#else
+enum {
+    invalid_map_error		= EBADF,
+    invalid_offset_error	= EINVAL,
+};
+#endif
+
 struct SYSPP_DLLIMPORT info
 {
     size_t	page_size;
@@ -119,14 +138,15 @@ public:
     typedef DWORDLONG	off_type;
     typedef size_t	size_type;
 
-    // note that handle object is passed by a reference
-    // so the map_impl class could take ownership over it
+    // note that handle objects are passed by a reference
+    // so the map_impl class could take ownership over them
     //
-    map_impl (sys::handle& handle, off_type size, DWORD mode)
-       	: backend (handle), backend_size (size), access (mode) { }
+    map_impl (sys::handle& handle, sys::file_handle& file, off_type size, DWORD mode)
+       	: backend (handle), file_backend (file), backend_size (size), access (mode) { }
 
     void* map (off_type offset = 0, size_type size = 0)
 	{
+	    SYSPP_LATENCY_SCOPE (probe_map);
 	    off_type page_offset (0);
 	    if (offset)
 	    {
@@ -151,9 +171,17 @@ public:
     bool writeable () const
        	{ return access & (FILE_MAP_WRITE|FILE_MAP_COPY); }
 
+    bool copy_on_write () const { return access == FILE_MAP_COPY; }
+
+    // file ()
+    //
+    // Returns: handle of the mapped file.
+    sys::raw_handle file () const { return file_backend; }
+
 private:
 
     sys::handle		backend;
+    sys::file_handle	file_backend;
     const off_type	backend_size;
     const DWORD		access;
 };
@@ -174,6 +202,7 @@ public:
 
     void* map (off_type offset = 0, size_type size = 0)
 	{
+	    SYSPP_LATENCY_SCOPE (probe_map);
 	    off_type page_offset (0);
 	    if (offset)
 	    {
@@ -206,6 +235,13 @@ public:
 
     bool writeable () const { return protect & PROT_WRITE; }
 
+    bool copy_on_write () const { return map_flags == MAP_PRIVATE; }
+
+    // file ()
+    //
+    // Returns: handle of the mapped file.
+    sys::raw_handle file () const { return backend; }
+
 private:
 
     sys::file_handle	backend;
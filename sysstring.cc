@@ -53,7 +53,8 @@ SYSPP_DLLIMPORT int wcstombs (const wstring& wstr, string& cstr, unsigned codepa
 	    return 0;
 	count = ::WideCharToMultiByte (codepage, 0, wstr.data(), wstr.size(),
 				       cbuf.get(), 0, 0, 0);
-	cbuf.reserve (count);
+	cbuf.clear();
+	cbuf.resize (count);
 	count = ::WideCharToMultiByte (codepage, 0, wstr.data(), wstr.size(),
 				       cbuf.get(), cbuf.size(), 0, 0);
 	if (!count) return 0;
@@ -78,7 +79,8 @@ SYSPP_DLLIMPORT int mbstowcs (const string& cstr, wstring& wstr, unsigned codepa
 	    return 0;
 	count = ::MultiByteToWideChar (codepage, 0, cstr.data(), cstr.size(),
 				       wbuf.get(), 0);
-	wbuf.reserve (count);
+	wbuf.clear();
+	wbuf.resize (count);
 	count = ::MultiByteToWideChar (codepage, 0, cstr.data(), cstr.size(),
 				       wbuf.get(), wbuf.size());
 	if (!count) return 0;
@@ -36,6 +36,9 @@
 #endif // SYSPP_USE_EXT_STRING
 #include <climits>	// for MB_LEN_MAX
 #include <iterator>	// for std::back_inserter
+#include <memory>	// for std::allocator
+#include <type_traits>	// for std::is_trivial
+#include <cstring>	// for std::memcpy
 #include <cassert>
 #include "sysdef.h"
 #include "bindata.h"
@@ -424,51 +427,136 @@ inline int u32tou8 (const u32string& src, string& dst)
     return u32tou8 (src.begin(), src.end(), std::back_inserter (dst));
 }
 
+#ifndef SYSPP_USE_EXT_STRING
+// conversions between strings with custom allocators, e.g. sys::arena_string
+
+template <class SrcAlloc, class DstAlloc>
+int u8tou16 (const basic_string<char, std::char_traits<char>, SrcAlloc>& src,
+	     basic_string<WChar16, std::char_traits<WChar16>, DstAlloc>& dst)
+{
+    dst.clear();
+    if (dst.capacity() < src.size())
+	dst.reserve (src.size());
+    return u8tou16 (src.begin(), src.end(), std::back_inserter (dst));
+}
+
+template <class SrcAlloc, class DstAlloc>
+int u32tou16 (const basic_string<WChar32, std::char_traits<WChar32>, SrcAlloc>& src,
+	      basic_string<WChar16, std::char_traits<WChar16>, DstAlloc>& dst)
+{
+    dst.clear();
+    if (dst.capacity() < src.size())
+	dst.reserve (src.size());
+    return u32tou16 (src.begin(), src.end(), std::back_inserter (dst));
+}
+
+template <class SrcAlloc, class DstAlloc>
+int u16tou8 (const basic_string<WChar16, std::char_traits<WChar16>, SrcAlloc>& src,
+	     basic_string<char, std::char_traits<char>, DstAlloc>& dst)
+{
+    dst.clear();
+    if (dst.capacity() < src.size())
+	dst.reserve (src.size());
+    return u16tou8 (src.begin(), src.end(), std::back_inserter (dst));
+}
+
+template <class SrcAlloc, class DstAlloc>
+int u32tou8 (const basic_string<WChar32, std::char_traits<WChar32>, SrcAlloc>& src,
+	     basic_string<char, std::char_traits<char>, DstAlloc>& dst)
+{
+    dst.clear();
+    if (dst.capacity() < src.size())
+	dst.reserve (src.size());
+    return u32tou8 (src.begin(), src.end(), std::back_inserter (dst));
+}
+#endif
+
 // ---------------------------------------------------------------------------
 /// \class local_buffer
 /// \brief Buffer that uses stack for small allocations and dynamic memory for larger ones.
-
-template <class T, size_t default_size = ((255 - sizeof(T*)*2) / sizeof(T) + 1)>
-class local_buffer
+///
+/// First DEFAULT_SIZE elements are stored within the object itself, larger
+/// buffers are obtained from the allocator of type ALLOC, e.g.
+/// sys::arena_allocator could be used to draw them from a memory arena.
+/// Contents are preserved when buffer grows.  Elements of trivial types are
+/// left uninitialized.
+
+template <class T, size_t default_size = ((255 - sizeof(T*)*3) / sizeof(T) + 1),
+	  class Alloc = std::allocator<T> >
+class local_buffer : private Alloc
 {
 public:
     typedef T		value_type;
     typedef size_t	size_type;
     typedef T*          iterator;
     typedef const T*    const_iterator;
+    typedef Alloc	allocator_type;
 
-    local_buffer () : m_size (default_size) { m_ptr = m_buf; }
+    local_buffer ()
+	: m_size (0), m_capacity (default_size), m_ptr (m_inline())
+	{ resize (default_size); }
 
-    explicit local_buffer (size_t initial_size)
+    explicit local_buffer (const allocator_type& alloc)
+	: allocator_type (alloc), m_size (0), m_capacity (default_size), m_ptr (m_inline())
+	{ resize (default_size); }
+
+    explicit local_buffer (size_t initial_size,
+			   const allocator_type& alloc = allocator_type())
+	: allocator_type (alloc), m_size (0), m_capacity (default_size), m_ptr (m_inline())
+	{ resize (initial_size > default_size ? initial_size : default_size); }
+
+    /// moved-from buffer is left empty.
+    local_buffer (local_buffer&& other)
+	: allocator_type (std::move (other))
+	, m_size (0), m_capacity (default_size), m_ptr (m_inline())
+	{ m_steal (other); }
+
+    local_buffer& operator= (local_buffer&& other)
 	{
-	    if (initial_size > default_size)
-	    {
-		m_ptr = new value_type[initial_size];
-		m_size = initial_size;
-	    }
-	    else
+	    if (this != &other)
 	    {
-		m_ptr = m_buf;
-		m_size = default_size;
+		m_free();
+		allocator_type::operator= (std::move (other));
+		m_steal (other);
 	    }
+	    return *this;
 	}
 
-    ~local_buffer () { if (m_ptr != m_buf) delete[] m_ptr; }
+    ~local_buffer () { m_free(); }
 
     /// make sure buffer is enough to hold SIZE objects, reallocating if necessary.
-    /// old contents is lost after reallocation. 
+    /// old contents is preserved.
     void reserve (size_t size)
 	{
 	    if (size > m_size)
-	    {
-		value_type* new_ptr = new value_type[size];
-		if (m_ptr != m_buf) delete[] m_ptr;
-		m_ptr = new_ptr;
-		m_size = size;
-	    }
+		resize (size);
+	}
+
+    /// resize (SIZE)
+    /// \brief  change buffer size to SIZE objects, preserving old contents.
+    ///         storage is not released when buffer shrinks.
+    void resize (size_t size)
+	{
+	    if (size > m_capacity)
+		m_reallocate (size);
+	    if (size > m_size)
+		m_construct (m_ptr + m_size, m_ptr + size);
+	    else
+		m_destroy (m_ptr + size, m_ptr + m_size);
+	    m_size = size;
 	}
 
+    /// grow ()
+    /// \brief  at least double buffer size, preserving old contents.
+    void grow () { resize (m_size > default_size/2 ? m_size * 2 : default_size); }
+
+    /// clear ()
+    /// \brief  make buffer empty, so that subsequent growth does not copy
+    ///         discarded contents.
+    void clear () { resize (0); }
+
     size_type size () const { return m_size; }
+    size_type capacity () const { return m_capacity; }
 
     value_type* get () { return m_ptr; }
     const value_type* get () const { return m_ptr; }
@@ -482,14 +570,86 @@ public:
     value_type& operator[] (std::ptrdiff_t i) { return m_ptr[i]; }
     const value_type& operator[] (std::ptrdiff_t i) const { return m_ptr[i]; }
 
-private:
+    allocator_type get_allocator () const { return *this; }
 
+private:
     local_buffer (const local_buffer&);		// not defined
     local_buffer& operator= (const local_buffer&);
 
+    value_type* m_inline () { return reinterpret_cast<value_type*> (m_buf); }
+
+    static void m_construct (value_type* first, value_type* last)
+	{
+	    if (!std::is_trivial<value_type>::value)
+		for ( ; first != last; ++first)
+		    ::new (static_cast<void*> (first)) value_type;
+	}
+
+    static void m_destroy (value_type* first, value_type* last)
+	{
+	    if (!std::is_trivial<value_type>::value)
+		for ( ; first != last; ++first)
+		    first->~value_type();
+	}
+
+    // m_relocate (FIRST, LAST, DEST)
+    // Effects: moves objects from range [FIRST, LAST) into uninitialized
+    //          storage at DEST, destroying the originals.
+    static void m_relocate (value_type* first, value_type* last, value_type* dest)
+	{
+	    if (std::is_trivial<value_type>::value)
+		std::memcpy (static_cast<void*> (dest), static_cast<const void*> (first),
+			     (last - first) * sizeof(value_type));
+	    else
+		for ( ; first != last; ++first, ++dest)
+		{
+		    ::new (static_cast<void*> (dest)) value_type (std::move (*first));
+		    first->~value_type();
+		}
+	}
+
+    void m_reallocate (size_type capacity)
+	{
+	    value_type* ptr = allocator_type::allocate (capacity);
+	    m_relocate (m_ptr, m_ptr + m_size, ptr);
+	    if (m_ptr != m_inline())
+		allocator_type::deallocate (m_ptr, m_capacity);
+	    m_ptr = ptr;
+	    m_capacity = capacity;
+	}
+
+    void m_free ()
+	{
+	    m_destroy (m_ptr, m_ptr + m_size);
+	    if (m_ptr != m_inline())
+		allocator_type::deallocate (m_ptr, m_capacity);
+	    m_ptr = m_inline();
+	    m_size = 0;
+	    m_capacity = default_size;
+	}
+
+    // m_steal (OTHER)
+    // Effects: moves contents of OTHER into this empty buffer, leaving OTHER
+    //          empty.
+    void m_steal (local_buffer& other)
+	{
+	    if (other.m_ptr != other.m_inline())
+	    {
+		m_ptr = other.m_ptr;
+		m_capacity = other.m_capacity;
+		other.m_ptr = other.m_inline();
+		other.m_capacity = default_size;
+	    }
+	    else
+		m_relocate (other.m_ptr, other.m_ptr + other.m_size, m_ptr);
+	    m_size = other.m_size;
+	    other.m_size = 0;
+	}
+
     size_type		m_size;
+    size_type		m_capacity;
     value_type*		m_ptr;
-    value_type		m_buf[default_size];
+    alignas(value_type) unsigned char m_buf[default_size * sizeof(value_type)];
 };
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,215 @@
+// -*- C++ -*-
+//! \file        sysuring.cc
+//! \brief       minimal io_uring wrapper implementation.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include "sysuring.h"
+
+#if SYSPP_HAS_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>	// for std::memset
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter	426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register	427
+#endif
+
+namespace {
+
+// IORING_REGISTER_IOWQ_MAX_WORKERS is an enumerator of <linux/io_uring.h>,
+// not a macro, so it could not be tested by the preprocessor
+const unsigned register_iowq_max_workers = 19;
+
+} // anonymous namespace
+
+namespace sys { namespace detail {
+
+io_ring::
+io_ring ()
+    : m_fd (-1), m_sq_entries (0), m_sq_ring (MAP_FAILED), m_sq_ring_size (0)
+    , m_cq_ring (MAP_FAILED), m_cq_ring_size (0), m_sqes (0), m_sqes_size (0)
+    , m_sq_local_tail (0), m_sq_submitted (0)
+{
+    std::memset (m_supported, 0, sizeof(m_supported));
+}
+
+io_ring::
+~io_ring ()
+{
+    close();
+}
+
+void io_ring::
+close ()
+{
+    if (m_sqes)
+	::munmap (m_sqes, m_sqes_size);
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+	::munmap (m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring != MAP_FAILED)
+	::munmap (m_sq_ring, m_sq_ring_size);
+    if (m_fd != -1)
+	::close (m_fd);
+    m_fd = -1;
+    m_sq_ring = m_cq_ring = MAP_FAILED;
+    m_sqes = 0;
+}
+
+result<void> io_ring::
+open (unsigned entries)
+{
+    close();
+
+    io_uring_params params;
+    std::memset (&params, 0, sizeof(params));
+    m_fd = ::syscall (__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0)
+    {
+	m_fd = -1;
+	return error_code::last();
+    }
+    m_sq_entries = params.sq_entries;
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && m_cq_ring_size > m_sq_ring_size)
+	m_sq_ring_size = m_cq_ring_size;
+
+    m_sq_ring = ::mmap (0, m_sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED)
+    {
+	int err = errno;
+	close();
+	return error_code (err);
+    }
+    if (single_mmap)
+	m_cq_ring = m_sq_ring;
+    else
+    {
+	m_cq_ring = ::mmap (0, m_cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			    m_fd, IORING_OFF_CQ_RING);
+	if (m_cq_ring == MAP_FAILED)
+	{
+	    int err = errno;
+	    close();
+	    return error_code (err);
+	}
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap (0, m_sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			 m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+	int err = errno;
+	close();
+	return error_code (err);
+    }
+    m_sqes = static_cast<io_uring_sqe*> (sqes);
+
+    char* sq = static_cast<char*> (m_sq_ring);
+    m_sq_head  = reinterpret_cast<unsigned*> (sq + params.sq_off.head);
+    m_sq_tail  = reinterpret_cast<unsigned*> (sq + params.sq_off.tail);
+    m_sq_mask  = reinterpret_cast<unsigned*> (sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*> (sq + params.sq_off.array);
+    char* cq = static_cast<char*> (m_cq_ring);
+    m_cq_head  = reinterpret_cast<unsigned*> (cq + params.cq_off.head);
+    m_cq_tail  = reinterpret_cast<unsigned*> (cq + params.cq_off.tail);
+    m_cq_mask  = reinterpret_cast<unsigned*> (cq + params.cq_off.ring_mask);
+    m_cqes     = reinterpret_cast<io_uring_cqe*> (cq + params.cq_off.cqes);
+    m_sq_local_tail = m_sq_submitted = *m_sq_tail;
+
+    // operations supported by the kernel; probing appeared together with
+    // most non-rw operations, so its failure means they are absent
+    size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    alignas(io_uring_probe) char probe_buf[sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)];
+    std::memset (probe_buf, 0, probe_size);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*> (probe_buf);
+    if (::syscall (__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+    {
+	for (unsigned i = 0; i < probe->ops_len && i < 256; ++i)
+	    if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+		m_supported[probe->ops[i].op] = 1;
+    }
+    return result<void>();
+}
+
+bool io_ring::
+supports (unsigned opcode) const
+{
+    return opcode < sizeof(m_supported) && m_supported[opcode];
+}
+
+result<void> io_ring::
+set_max_workers (unsigned bounded, unsigned unbounded)
+{
+    unsigned limits[2] = { bounded, unbounded };
+    if (::syscall (__NR_io_uring_register, m_fd, register_iowq_max_workers, limits, 2) < 0)
+	return error_code::last();
+    return result<void>();
+}
+
+io_uring_sqe* io_ring::
+get_sqe ()
+{
+    unsigned head = __atomic_load_n (m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sq_local_tail - head >= m_sq_entries)
+	return 0;
+    unsigned index = m_sq_local_tail & *m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset (sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+result<unsigned> io_ring::
+submit (unsigned wait)
+{
+    __atomic_store_n (m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sq_local_tail - m_sq_submitted;
+    long rc = ::syscall (__NR_io_uring_enter, m_fd, to_submit, wait,
+			 wait ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+    if (rc < 0)
+    {
+	// interrupted or completion queue is full, retry after reaping
+	if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+	    return 0u;
+	return error_code::last();
+    }
+    m_sq_submitted += rc;
+    return unsigned (rc);
+}
+
+} } // namespace sys::detail
+
+#endif // SYSPP_HAS_IO_URING
@@ -0,0 +1,140 @@
+// -*- C++ -*-
+//! \file        sysuring.h
+//! \brief       minimal io_uring wrapper.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef SYSPP_SYSURING_H
+#define SYSPP_SYSURING_H
+
+#include "sysdef.h"
+#include "syserror.h"
+
+#if defined(__linux__) && !defined(SYSPP_HAS_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SYSPP_HAS_IO_URING 1
+#endif
+#endif
+
+#if SYSPP_HAS_IO_URING
+
+#include <linux/io_uring.h>
+
+namespace sys { namespace detail {
+
+/// \class io_ring
+/// \brief minimal io_uring submission/completion queue pair.
+///
+/// Ring is driven by raw system calls and does not depend on liburing.  It is
+/// not thread-safe; submission and completion queues should be accessed by a
+/// single thread.
+
+class SYSPP_DLLIMPORT io_ring
+{
+public:
+    io_ring ();
+    ~io_ring ();
+
+    // open (ENTRIES)
+    // Effects: creates ring with ENTRIES submission slots (rounded up to a
+    //          power of 2 by the kernel).
+    // Returns: system error code if io_uring is not available.
+    result<void> open (unsigned entries);
+
+    bool is_open () const { return m_fd != -1; }
+
+    // supports (OPCODE)
+    // Returns: true if the kernel implements IORING_OP_* operation OPCODE.
+    bool supports (unsigned opcode) const;
+
+    unsigned entries () const { return m_sq_entries; }
+
+    // set_max_workers (BOUNDED, UNBOUNDED)
+    // Effects: limits number of kernel worker threads serving operations that
+    //          cannot complete inline (0 leaves the limit unchanged).  Bounded
+    //          workers handle regular file and metadata operations.
+    // Returns: system error code, EINVAL if the kernel does not support the
+    //          limit (before Linux 5.15).
+    result<void> set_max_workers (unsigned bounded, unsigned unbounded);
+
+    // get_sqe ()
+    // Returns: zeroed submission entry to be filled by the caller, or null
+    //          pointer if submission queue is full.
+    io_uring_sqe* get_sqe ();
+
+    // submit (WAIT)
+    // Effects: passes prepared entries to the kernel and waits until at least
+    //          WAIT completions are available.
+    // Returns: number of entries submitted, or system error code.
+    result<unsigned> submit (unsigned wait);
+
+    // peek_cqe ()
+    // Returns: oldest unprocessed completion, or null pointer.
+    const io_uring_cqe* peek_cqe ()
+	{
+	    unsigned head = *m_cq_head;
+	    if (head == __atomic_load_n (m_cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	    return &m_cqes[head & *m_cq_mask];
+	}
+
+    // cqe_seen ()
+    // Effects: releases completion returned by peek_cqe.
+    void cqe_seen ()
+	{ __atomic_store_n (m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE); }
+
+private:
+    io_ring (const io_ring&);			// not defined
+    io_ring& operator= (const io_ring&);	// not defined
+
+    void close ();
+
+    int			m_fd;
+    unsigned		m_sq_entries;
+    void*		m_sq_ring;
+    size_t		m_sq_ring_size;
+    void*		m_cq_ring;		// same as m_sq_ring with single mmap
+    size_t		m_cq_ring_size;
+    io_uring_sqe*	m_sqes;
+    size_t		m_sqes_size;
+
+    unsigned*		m_sq_head;
+    unsigned*		m_sq_tail;
+    unsigned*		m_sq_mask;
+    unsigned*		m_sq_array;
+    unsigned		m_sq_local_tail;	// prepared, not yet published
+    unsigned		m_sq_submitted;		// published to the kernel
+
+    unsigned*		m_cq_head;
+    unsigned*		m_cq_tail;
+    unsigned*		m_cq_mask;
+    io_uring_cqe*	m_cqes;
+
+    unsigned char	m_supported[256];	// IORING_OP_* support flags
+};
+
+} } // namespace sys::detail
+
+#endif // SYSPP_HAS_IO_URING
+
+#endif /* SYSPP_SYSURING_H */
@@ -0,0 +1,353 @@
+// -*- C++ -*-
+//! \file        syswalk.cc
+//! \brief       parallel recursive directory traversal.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#include "syswalk.h"
+#include "sysatomic.h"
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstring>	// for std::strlen
+
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+namespace sys {
+
+namespace {
+
+// open directory shared by the tasks scanning its subdirectories
+struct dir_node : public refcount_base
+{
+    file_handle		handle;
+};
+
+struct walk_task
+{
+    refcount_ptr<dir_node>	parent;	// null for the root
+    string			path;
+    size_t			name_pos; // position of the name within path, 0 for the root
+    unsigned			depth;	  // depth of the directory entries
+};
+
+// work queue of a single thread.  owner takes tasks from the back, thieves
+// from the front, so that owner proceeds depth-first within its subtree.
+struct work_queue
+{
+    std::mutex			lock;
+    std::deque<walk_task>	tasks;
+};
+
+class walker
+{
+public:
+    typedef std::function<void (std::vector<walk_entry>&)> batch_func;
+
+    walker (const batch_func& on_batch, const walk_options& options, unsigned threads)
+	: m_on_batch (on_batch), m_options (options), m_queues (threads)
+	, m_queued (0), m_pending (0), m_sleepers (0), m_count (0), m_abort (false)
+	{ }
+
+    void push (unsigned worker, walk_task& task);
+    void run (unsigned worker);
+
+    size_t count () const { return m_count; }
+
+    void rethrow ()
+	{
+	    if (m_exception)
+		std::rethrow_exception (m_exception);
+	}
+
+private:
+    bool pop (unsigned worker, walk_task& task);
+    void scan (unsigned worker, walk_task& task, std::vector<walk_entry>& batch);
+    void flush (std::vector<walk_entry>& batch);
+    void report_error (const string& path, int error);
+    void finish_task ();
+
+    const batch_func&		m_on_batch;
+    const walk_options&		m_options;
+    std::vector<work_queue>	m_queues;
+
+    sys::atomic<size_t>		m_queued;	// tasks in the queues
+    sys::atomic<size_t>		m_pending;	// tasks queued or in progress
+    sys::atomic<unsigned>	m_sleepers;
+    std::mutex			m_idle_lock;
+    std::condition_variable	m_idle;
+
+    std::mutex			m_output_lock;	// serializes callbacks
+    size_t			m_count;
+    sys::atomic<bool>		m_abort;
+    std::exception_ptr		m_exception;
+};
+
+void walker::
+push (unsigned worker, walk_task& task)
+{
+    m_pending.fetch_add (1);
+    {
+	std::lock_guard<std::mutex> lock (m_queues[worker].lock);
+	m_queues[worker].tasks.push_back (std::move (task));
+    }
+    m_queued.fetch_add (1);
+    if (m_sleepers.load())
+    {
+	std::lock_guard<std::mutex> lock (m_idle_lock);
+	m_idle.notify_one();
+    }
+}
+
+bool walker::
+pop (unsigned worker, walk_task& task)
+{
+    {
+	work_queue& own = m_queues[worker];
+	std::lock_guard<std::mutex> lock (own.lock);
+	if (!own.tasks.empty())
+	{
+	    task = std::move (own.tasks.back());
+	    own.tasks.pop_back();
+	    m_queued.fetch_sub (1);
+	    return true;
+	}
+    }
+    for (size_t i = 1; i < m_queues.size(); ++i)
+    {
+	work_queue& victim = m_queues[(worker + i) % m_queues.size()];
+	std::lock_guard<std::mutex> lock (victim.lock);
+	if (!victim.tasks.empty())
+	{
+	    task = std::move (victim.tasks.front());
+	    victim.tasks.pop_front();
+	    m_queued.fetch_sub (1);
+	    return true;
+	}
+    }
+    return false;
+}
+
+void walker::
+finish_task ()
+{
+    if (m_pending.fetch_sub (1) == 1)
+    {
+	std::lock_guard<std::mutex> lock (m_idle_lock);
+	m_idle.notify_all();
+    }
+}
+
+void walker::
+run (unsigned worker)
+{
+    std::vector<walk_entry> batch;
+    batch.reserve (m_options.batch_size);
+    for (;;)
+    {
+	walk_task task;
+	if (pop (worker, task))
+	{
+	    if (!m_abort.load (memory_order_relaxed))
+	    {
+		try
+		{
+		    scan (worker, task, batch);
+		}
+		catch (...)
+		{
+		    std::lock_guard<std::mutex> lock (m_output_lock);
+		    if (!m_exception)
+			m_exception = std::current_exception();
+		    m_abort.store (true);
+		}
+	    }
+	    finish_task();
+	    continue;
+	}
+	if (m_pending.load() == 0)
+	    break;
+	std::unique_lock<std::mutex> lock (m_idle_lock);
+	m_sleepers.fetch_add (1);
+	m_idle.wait (lock, [this] { return m_queued.load() != 0 || m_pending.load() == 0; });
+	m_sleepers.fetch_sub (1);
+    }
+    if (!batch.empty() && !m_abort.load())
+    {
+	try
+	{
+	    flush (batch);
+	}
+	catch (...)
+	{
+	    std::lock_guard<std::mutex> lock (m_output_lock);
+	    if (!m_exception)
+		m_exception = std::current_exception();
+	}
+    }
+}
+
+void walker::
+scan (unsigned worker, walk_task& task, std::vector<walk_entry>& batch)
+{
+    dir_iterator it;
+    result<void> rc;
+#ifdef _WIN32
+    rc = it.try_open (task.path.c_str());
+#else
+    refcount_ptr<dir_node> node (new dir_node);
+    if (task.parent)
+	node->handle = ::openat (task.parent->handle, task.path.c_str() + task.name_pos,
+				 O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    else
+	node->handle = ::open (task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!node->handle)
+	rc = error_code::last();
+    else
+	rc = it.try_open (node->handle.get());
+#endif
+    task.parent.reset();
+    if (!rc)
+    {
+	if (!task.name_pos)
+	    throw file_error (rc.error(), task.path.c_str());
+	report_error (task.path, rc.error());
+	return;
+    }
+
+    for (dir_iterator end; it != end; )
+    {
+	const dir_entry& entry = *it;
+	walk_entry item;
+	item.path.reserve (task.path.size() + 1 + std::strlen (entry.name()));
+	item.path = task.path;
+	if (!item.path.empty() && item.path[item.path.size()-1] != '/')
+	    item.path += '/';
+	size_t name_pos = item.path.size();
+	item.path += entry.name();
+	item.type = entry.type();
+	item.depth = task.depth;
+	item.size = 0;
+	item.mtime = file::time::ftime_type();
+	if (m_options.stat)
+	{
+	    item.size = entry.try_size().value_or (0);
+	    if (result<file::time> mtime = entry.try_mod_time())
+		item.mtime = mtime->get();
+	}
+
+	bool descend = item.type == file::directory_file
+		       && !(m_options.prune && m_options.prune (item));
+	if (descend)
+	{
+	    walk_task child;
+	    child.path = item.path;
+	    child.name_pos = name_pos;
+	    child.depth = task.depth + 1;
+#ifndef _WIN32
+	    child.parent = node;
+#endif
+	    push (worker, child);
+	}
+	if (!m_options.filter || m_options.filter (item))
+	{
+	    batch.push_back (std::move (item));
+	    if (batch.size() >= m_options.batch_size)
+		flush (batch);
+	}
+
+	rc = it.try_increment();
+	if (!rc)
+	{
+	    report_error (task.path, rc.error());
+	    break;
+	}
+	if (m_abort.load (memory_order_relaxed))
+	    break;
+    }
+}
+
+void walker::
+flush (std::vector<walk_entry>& batch)
+{
+    std::lock_guard<std::mutex> lock (m_output_lock);
+    m_count += batch.size();
+    m_on_batch (batch);
+    batch.clear();
+}
+
+void walker::
+report_error (const string& path, int error)
+{
+    if (m_options.on_error)
+    {
+	std::lock_guard<std::mutex> lock (m_output_lock);
+	m_options.on_error (path, error);
+    }
+}
+
+} // anonymous namespace
+
+size_t
+walk_tree (const char* root,
+	   const std::function<void (std::vector<walk_entry>&)>& on_batch,
+	   const walk_options& options)
+{
+    unsigned threads = options.threads;
+    if (!threads)
+	threads = std::thread::hardware_concurrency();
+    if (!threads)
+	threads = 1;
+
+    walker walk (on_batch, options, threads);
+    walk_task task;
+    task.path = root;
+    task.name_pos = 0;
+    task.depth = 0;
+    walk.push (0, task);
+
+    std::vector<std::thread> pool;
+    pool.reserve (threads - 1);
+    for (unsigned i = 1; i < threads; ++i)
+    {
+	try
+	{
+	    pool.push_back (std::thread (&walker::run, &walk, i));
+	}
+	catch (...)
+	{
+	    break;	// proceed with threads started so far
+	}
+    }
+    walk.run (0);
+    for (size_t i = 0; i < pool.size(); ++i)
+	pool[i].join();
+
+    walk.rethrow();
+    return walk.count();
+}
+
+} // namespace sys
@@ -0,0 +1,108 @@
+// -*- C++ -*-
+//! \file        syswalk.h
+//! \brief       parallel recursive directory traversal.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+#ifndef SYSPP_SYSWALK_H
+#define SYSPP_SYSWALK_H
+
+#include "sysfs.h"
+#include <vector>
+#include <functional>
+
+namespace sys {
+
+/// \struct walk_entry
+/// \brief file found by walk_tree.
+
+struct walk_entry
+{
+    string			path;	// root path followed by path within the tree
+    file::type_t		type;
+    unsigned			depth;	// 0 for the immediate children of the root
+    file::size_type		size;	// filled if walk_options::stat is set
+    file::time::ftime_type	mtime;	// same as above
+};
+
+/// \struct walk_options
+/// \brief parameters of walk_tree.
+///
+/// Callbacks are invoked concurrently from the worker threads, except for
+/// on_batch and on_error calls, which are serialized.
+
+struct walk_options
+{
+    // number of worker threads, including the calling one; 0 means number of
+    // hardware threads
+    unsigned	threads;
+
+    // number of entries passed to on_batch at once
+    size_t	batch_size;
+
+    // fill size and mtime of every entry passed to filter and on_batch
+    bool	stat;
+
+    // filter (ENTRY)
+    // Returns: false to exclude ENTRY from results.  Excluded directories
+    //          are still descended into.
+    std::function<bool (const walk_entry&)>	filter;
+
+    // prune (ENTRY)
+    // Returns: true to skip contents of the directory ENTRY.
+    std::function<bool (const walk_entry&)>	prune;
+
+    // on_error (PATH, ERROR)
+    // Effects: called for the directories that could not be read.
+    std::function<void (const string&, int)>	on_error;
+
+    walk_options () : threads (0), batch_size (256), stat (false) { }
+};
+
+// sys::walk_tree (ROOT, ON_BATCH, OPTIONS)
+// Effects: enumerates all files within directory ROOT and its subdirectories,
+//          passing them to ON_BATCH in batches of OPTIONS.batch_size entries
+//          in no particular order.  Subdirectories are scanned in parallel by
+//          a pool of threads that steal work from each other; directories are
+//          opened relative to their parent descriptors.  Symbolic links are
+//          not followed.
+// Returns: number of entries passed to ON_BATCH.
+// Throws: sys::file_error if ROOT could not be opened, or any exception
+//         thrown by callbacks, which stops the traversal.
+
+SYSPP_DLLIMPORT size_t
+walk_tree (const char* root,
+	   const std::function<void (std::vector<walk_entry>&)>& on_batch,
+	   const walk_options& options = walk_options());
+
+template <typename Ch, typename Tr, typename Al>
+inline size_t
+walk_tree (const basic_string<Ch,Tr,Al>& root,
+	   const std::function<void (std::vector<walk_entry>&)>& on_batch,
+	   const walk_options& options = walk_options())
+{
+    return walk_tree (root.c_str(), on_batch, options);
+}
+
+} // namespace sys
+
+#endif /* SYSPP_SYSWALK_H */
@@ -0,0 +1,561 @@
+// -*- C++ -*-
+//! \file        syswatch.cc
+//! \brief       file change notification implementation.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#include "syswatch.h"
+#include <map>
+#include <algorithm>	// for std::min
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <utility>	// for std::pair
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#endif
+
+namespace sys {
+
+namespace detail {
+
+class watch_backend
+{
+public:
+    virtual ~watch_backend () { }
+
+    virtual result<int> add (const char* path) = 0;
+    virtual void remove (int watch) = 0;
+    virtual result<void> read (std::vector<watch_event>& events, int timeout) = 0;
+    virtual raw_handle handle () const = 0;
+
+    // wake ()
+    // Effects: makes pending or next read() return without waiting.
+    virtual void wake () = 0;
+};
+
+// --- polling backend -------------------------------------------------------
+
+class polling_watch : public watch_backend
+{
+public:
+    explicit polling_watch (unsigned interval)
+	: m_interval (interval), m_next_id (0), m_woken (false)
+	, m_next_poll (clock::now() + m_interval)
+	{ }
+
+    result<int> add (const char* path);
+    void remove (int watch);
+    result<void> read (std::vector<watch_event>& events, int timeout);
+    raw_handle handle () const { return file_handle::invalid_handle(); }
+    void wake ();
+
+private:
+    typedef std::chrono::steady_clock		clock;
+    typedef std::map<string, file::status>	member_map;
+
+    enum {
+	status_mask = file::status_type | file::status_mode | file::status_inode
+		    | file::status_size | file::status_mtime | file::status_ctime
+    };
+
+    struct item
+    {
+	string		path;
+	bool		exists;
+	file::status	st;
+	member_map	members;	// directory members
+    };
+
+    static void list (const string& path, member_map& members);
+    static unsigned compare (const file::status& old_st, const file::status& new_st);
+    void scan (std::vector<watch_event>& events);
+
+    std::chrono::milliseconds	m_interval;
+    std::map<int, item>		m_items;
+    int				m_next_id;
+    bool			m_woken;
+    clock::time_point		m_next_poll;
+    std::mutex			m_lock;
+    std::condition_variable	m_wake;
+};
+
+void polling_watch::
+list (const string& path, member_map& members)
+{
+    members.clear();
+    dir_iterator it;
+    if (!it.try_open (path.c_str()))
+	return;
+    for (dir_iterator end; it != end; )
+    {
+	// directory listing supplies type, size and mtime relative to the
+	// open directory, which is enough to detect changes of its members
+	file::status& st = members[it->name()];
+	st.type = it->type();
+	st.size = it->try_size().value_or (0);
+	if (result<file::time> mtime = it->try_mod_time())
+	    st.mtime = *mtime;
+	if (!it.try_increment())
+	    break;
+    }
+}
+
+unsigned polling_watch::
+compare (const file::status& old_st, const file::status& new_st)
+{
+    if (old_st.type != new_st.type || old_st.inode != new_st.inode
+	|| old_st.device != new_st.device)
+	return watch_event::removed | watch_event::created;
+    if (old_st.size != new_st.size || old_st.mtime != new_st.mtime)
+	return watch_event::modified;
+    if (old_st.mode != new_st.mode || old_st.ctime != new_st.ctime)
+	return watch_event::attrib;
+    return 0;
+}
+
+result<int> polling_watch::
+add (const char* path)
+{
+    result<file::status> st = file::try_get_status (path, status_mask);
+    if (!st)
+	return error_code (st.error());
+
+    std::lock_guard<std::mutex> lock (m_lock);
+    int id = m_next_id++;
+    item& watch = m_items[id];
+    watch.path = path;
+    watch.exists = true;
+    watch.st = *st;
+    if (st->type == file::directory_file)
+	list (watch.path, watch.members);
+    return id;
+}
+
+void polling_watch::
+remove (int watch)
+{
+    std::lock_guard<std::mutex> lock (m_lock);
+    m_items.erase (watch);
+}
+
+void polling_watch::
+wake ()
+{
+    std::lock_guard<std::mutex> lock (m_lock);
+    m_woken = true;
+    m_wake.notify_all();
+}
+
+void polling_watch::
+scan (std::vector<watch_event>& events)
+{
+    watch_event event;
+    member_map members;
+    for (std::map<int, item>::iterator it = m_items.begin(); it != m_items.end(); ++it)
+    {
+	item& watch = it->second;
+	event.watch = it->first;
+
+	result<file::status> st = file::try_get_status (watch.path, status_mask);
+	event.changes = 0;
+	if (!st)
+	{
+	    if (watch.exists)
+		event.changes = watch_event::removed;
+	    watch.exists = false;
+	    watch.members.clear();
+	}
+	else
+	{
+	    event.changes = watch.exists ? compare (watch.st, *st) : unsigned (watch_event::created);
+	    watch.exists = true;
+	    watch.st = *st;
+	}
+	if (event.changes)
+	{
+	    event.path = watch.path;
+	    events.push_back (event);
+	}
+	if (!st || st->type != file::directory_file)
+	    continue;
+
+	// both maps are sorted by name, merge them
+	list (watch.path, members);
+	member_map::const_iterator old_it = watch.members.begin();
+	member_map::const_iterator new_it = members.begin();
+	while (old_it != watch.members.end() || new_it != members.end())
+	{
+	    const string* name;
+	    if (new_it == members.end()
+		|| (old_it != watch.members.end() && old_it->first < new_it->first))
+	    {
+		event.changes = watch_event::removed;
+		name = &old_it++->first;
+	    }
+	    else if (old_it == watch.members.end() || new_it->first < old_it->first)
+	    {
+		event.changes = watch_event::created;
+		name = &new_it++->first;
+	    }
+	    else
+	    {
+		event.changes = compare (old_it->second, new_it->second);
+		name = &new_it->first;
+		++old_it;
+		++new_it;
+	    }
+	    if (event.changes)
+	    {
+		event.path = watch.path;
+		if (!event.path.empty() && event.path[event.path.size()-1] != '/')
+		    event.path += '/';
+		event.path += *name;
+		events.push_back (event);
+	    }
+	}
+	watch.members.swap (members);
+    }
+}
+
+result<void> polling_watch::
+read (std::vector<watch_event>& events, int timeout)
+{
+    std::unique_lock<std::mutex> lock (m_lock);
+    clock::time_point deadline = timeout < 0 ? clock::time_point::max()
+			       : clock::now() + std::chrono::milliseconds (timeout);
+    for (;;)
+    {
+	if (m_woken)
+	{
+	    m_woken = false;
+	    return result<void>();
+	}
+	clock::time_point now = clock::now();
+	if (now >= m_next_poll)
+	{
+	    scan (events);
+	    m_next_poll = now + m_interval;
+	    return result<void>();
+	}
+	if (now >= deadline)
+	    return result<void>();
+	m_wake.wait_until (lock, std::min (m_next_poll, deadline));
+    }
+}
+
+#ifdef __linux__
+
+// --- inotify backend -------------------------------------------------------
+
+class inotify_watch : public watch_backend
+{
+public:
+    inotify_watch () { }
+
+    result<void> open ();
+
+    result<int> add (const char* path);
+    void remove (int watch);
+    result<void> read (std::vector<watch_event>& events, int timeout);
+    raw_handle handle () const { return m_fd.get(); }
+    void wake ();
+
+private:
+    enum { buffer_size = 65536 };
+
+    enum {
+	watch_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+		   | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF
+    };
+
+    static unsigned changes (bin::uint32_t mask);
+
+    file_handle			m_fd;
+    file_handle			m_wake_read;
+    file_handle			m_wake_write;
+    std::mutex			m_lock;
+    std::map<int, string>	m_paths;
+};
+
+result<void> inotify_watch::
+open ()
+{
+    m_fd = ::inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (!m_fd)
+	return error_code::last();
+    int pipe_fd[2];
+    if (-1 == ::pipe2 (pipe_fd, O_NONBLOCK | O_CLOEXEC))
+	return error_code::last();
+    m_wake_read = pipe_fd[0];
+    m_wake_write = pipe_fd[1];
+    return result<void>();
+}
+
+unsigned inotify_watch::
+changes (bin::uint32_t mask)
+{
+    unsigned changes = 0;
+    if (mask & (IN_MODIFY | IN_CLOSE_WRITE))
+	changes |= watch_event::modified;
+    if (mask & IN_ATTRIB)
+	changes |= watch_event::attrib;
+    if (mask & (IN_CREATE | IN_MOVED_TO))
+	changes |= watch_event::created;
+    if (mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF))
+	changes |= watch_event::removed;
+    if (mask & IN_Q_OVERFLOW)
+	changes |= watch_event::overflow;
+    return changes;
+}
+
+result<int> inotify_watch::
+add (const char* path)
+{
+    int wd = ::inotify_add_watch (m_fd, path, watch_mask);
+    if (wd == -1)
+	return error_code::last();
+    std::lock_guard<std::mutex> lock (m_lock);
+    m_paths[wd] = path;
+    return wd;
+}
+
+void inotify_watch::
+remove (int watch)
+{
+    std::lock_guard<std::mutex> lock (m_lock);
+    if (m_paths.erase (watch))
+	::inotify_rm_watch (m_fd, watch);
+}
+
+void inotify_watch::
+wake ()
+{
+    char c = 0;
+    while (::write (m_wake_write, &c, 1) == -1 && errno == EINTR)
+	;
+}
+
+result<void> inotify_watch::
+read (std::vector<watch_event>& events, int timeout)
+{
+    struct pollfd fds[2];
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wake_read;
+    fds[1].events = POLLIN;
+    int rc = ::poll (fds, 2, timeout);
+    if (rc == -1)
+	return errno == EINTR ? result<void>() : result<void> (error_code::last());
+    if (fds[1].revents & POLLIN)
+    {
+	char buf[64];
+	while (::read (m_wake_read, buf, sizeof(buf)) > 0)
+	    ;
+    }
+    if (!(fds[0].revents & POLLIN))
+	return result<void>();
+
+    // drain the queue and merge events for the same file
+    typedef std::map<std::pair<int, string>, size_t> index_map;
+    index_map index;
+    alignas(struct inotify_event) char buffer[buffer_size];
+    std::lock_guard<std::mutex> lock (m_lock);
+    for (;;)
+    {
+	ssize_t count = ::read (m_fd, buffer, buffer_size);
+	if (count == -1)
+	{
+	    if (errno == EAGAIN)
+		break;
+	    if (errno == EINTR)
+		continue;
+	    return error_code::last();
+	}
+	for (char* ptr = buffer; ptr < buffer + count; )
+	{
+	    const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*> (ptr);
+	    ptr += sizeof(struct inotify_event) + ev->len;
+
+	    unsigned what = changes (ev->mask);
+	    std::map<int, string>::iterator path = m_paths.find (ev->wd);
+	    if (ev->mask & IN_IGNORED)
+	    {
+		// watch removed by the kernel, or by remove()
+		if (path != m_paths.end())
+		    m_paths.erase (path);
+		continue;
+	    }
+	    if (!what || (path == m_paths.end() && !(what & watch_event::overflow)))
+		continue;
+
+	    index_map::key_type key (path != m_paths.end() ? ev->wd : -1,
+				     ev->len ? string (ev->name) : string());
+	    std::pair<index_map::iterator, bool> slot = index.insert (std::make_pair (key, events.size()));
+	    if (!slot.second)
+	    {
+		events[slot.first->second].changes |= what;
+		continue;
+	    }
+	    watch_event event;
+	    event.watch = key.first;
+	    event.changes = what;
+	    if (path != m_paths.end())
+	    {
+		event.path = path->second;
+		if (ev->len)
+		{
+		    if (!event.path.empty() && event.path[event.path.size()-1] != '/')
+			event.path += '/';
+		    event.path += ev->name;
+		}
+	    }
+	    events.push_back (event);
+	}
+    }
+    return result<void>();
+}
+
+#endif // __linux__
+
+} // namespace detail
+
+// --- watcher ---------------------------------------------------------------
+
+watcher::
+watcher (backend_t backend, unsigned interval) : m_type (polling_backend), m_stopping (false)
+{
+    if (backend != polling_backend)
+    {
+#ifdef __linux__
+	std::unique_ptr<detail::inotify_watch> inotify (new detail::inotify_watch);
+	result<void> rc = inotify->open();
+	if (rc)
+	{
+	    m_backend.reset (inotify.release());
+	    m_type = inotify_backend;
+	}
+	else if (backend == inotify_backend)
+	    throw generic_error (rc.error());
+#else
+	if (backend == inotify_backend)
+#ifdef _WIN32
+	    throw generic_error (ERROR_NOT_SUPPORTED);
+#else
+	    throw generic_error (ENOSYS);
+#endif
+#endif
+    }
+    if (!m_backend)
+	m_backend.reset (new detail::polling_watch (interval));
+}
+
+watcher::
+~watcher ()
+{
+    stop();
+}
+
+result<int> watcher::
+try_add (const char* path)
+{
+    return m_backend->add (path);
+}
+
+int watcher::
+add (const char* path)
+{
+    result<int> watch = try_add (path);
+    if (!watch)
+	throw file_error (watch.error(), path);
+    return *watch;
+}
+
+void watcher::
+remove (int watch)
+{
+    m_backend->remove (watch);
+}
+
+result<size_t> watcher::
+try_read (std::vector<watch_event>& events, int timeout)
+{
+    size_t count = events.size();
+    result<void> rc = m_backend->read (events, timeout);
+    if (!rc)
+	return error_code (rc.error());
+    return events.size() - count;
+}
+
+size_t watcher::
+read (std::vector<watch_event>& events, int timeout)
+{
+    result<size_t> count = try_read (events, timeout);
+    if (!count)
+	throw generic_error (count.error());
+    return *count;
+}
+
+raw_handle watcher::
+handle () const
+{
+    return m_backend->handle();
+}
+
+void watcher::
+start (const callback_type& callback)
+{
+    stop();
+    m_callback = callback;
+    m_stopping.store (false);
+    m_thread = std::thread (&watcher::m_run, this);
+}
+
+void watcher::
+stop ()
+{
+    if (!m_thread.joinable())
+	return;
+    m_stopping.store (true);
+    m_backend->wake();
+    m_thread.join();
+}
+
+void watcher::
+m_run ()
+{
+    std::vector<watch_event> events;
+    while (!m_stopping.load())
+    {
+	events.clear();
+	if (!try_read (events, -1))
+	    break;
+	if (!events.empty() && !m_stopping.load())
+	    m_callback (events);
+    }
+}
+
+} // namespace sys
@@ -0,0 +1,158 @@
+// -*- C++ -*-
+//! \file        syswatch.h
+//! \brief       file change notification.
+//
+// Copyright (C) 2010 by poddav
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+
+
+#ifndef SYSPP_SYSWATCH_H
+#define SYSPP_SYSWATCH_H
+
+#include "sysfs.h"
+#include "sysatomic.h"
+#include <vector>
+#include <memory>	// for std::unique_ptr
+#include <functional>
+#include <thread>
+
+namespace sys {
+
+namespace detail { class watch_backend; }
+
+/// \struct watch_event
+/// \brief change of a file reported by sys::watcher.
+///
+/// Events for the same file that arrive together are coalesced into a single
+/// watch_event with several change bits set.
+
+struct watch_event
+{
+    enum change_t {
+	modified	= 0x01,	// contents changed
+	attrib		= 0x02,	// metadata changed
+	created		= 0x04,	// file created or moved in
+	removed		= 0x08,	// file deleted or moved out
+	overflow	= 0x10,	// events were lost, rescan everything
+    };
+
+    int		watch;		// id returned by watcher::add, -1 for overflow
+    string	path;		// watched path, or path of the directory member
+    unsigned	changes;	// combination of change_t bits
+};
+
+/// \class watcher
+/// \brief notification about changes of files and directories.
+///
+/// On Linux changes are delivered by inotify; elsewhere, or when inotify
+/// instances are exhausted, watched paths are polled with a single
+/// file::try_get_status call per file every poll interval.  inotify is tried
+/// once, at construction, and polling is used only if that fails; running
+/// out of the per-user watch limit (fs.inotify.max_user_watches) later makes
+/// try_add fail with ENOSPC rather than fall back to polling.  Events are
+/// collected either by read(), possibly after the handle() became readable,
+/// or by a background thread started with start().
+///
+/// Watching a directory reports changes of its immediate members.  Files
+/// replaced by rename (as most editors and atomic writers do) are better
+/// watched through their directory: a watch on the file itself is removed
+/// together with the replaced file.
+
+class SYSPP_DLLIMPORT watcher
+{
+public:
+    enum backend_t {
+	auto_backend,		// inotify if available, polling otherwise
+	inotify_backend,
+	polling_backend,
+    };
+
+    typedef std::function<void (std::vector<watch_event>&)> callback_type;
+
+    // watcher (BACKEND, INTERVAL)
+    // Effects: creates watcher with no watches.  INTERVAL is the polling
+    //          period in milliseconds, used by the polling backend only.
+    // Throws: sys::generic_error if inotify_backend was requested but is not
+    //         available.
+    explicit watcher (backend_t backend = auto_backend, unsigned interval = 1000);
+
+    ~watcher ();
+
+    backend_t backend () const { return m_type; }
+
+    // try_add (PATH)
+    // Effects: starts watching file or directory PATH.
+    // Returns: watch id, or system error code; ENOSPC if inotify watch limit
+    //          is reached.
+    result<int> try_add (const char* path);
+
+    // add (PATH)
+    // Returns: watch id.
+    // Throws: sys::file_error if PATH could not be watched.
+    int add (const char* path);
+
+    template <typename Ch, typename Tr, typename Al>
+    int add (const basic_string<Ch,Tr,Al>& path) { return add (path.c_str()); }
+
+    // remove (WATCH)
+    // Effects: stops watching the path identified by WATCH.
+    void remove (int watch);
+
+    // try_read (EVENTS, TIMEOUT)
+    // Effects: waits up to TIMEOUT milliseconds (forever if TIMEOUT is
+    //          negative) for changes and appends them to EVENTS.
+    // Returns: number of events appended, or system error code.
+    result<size_t> try_read (std::vector<watch_event>& events, int timeout = -1);
+
+    // read (EVENTS, TIMEOUT)
+    // Throws: sys::generic_error on failure.
+    size_t read (std::vector<watch_event>& events, int timeout = -1);
+
+    // handle ()
+    // Returns: descriptor that becomes readable when events are pending, to
+    //          be used with poll/epoll; invalid handle for the polling backend.
+    raw_handle handle () const;
+
+    // start (CALLBACK)
+    // Effects: starts thread that passes batches of events to CALLBACK until
+    //          stop() is called.  CALLBACK should not throw.
+    void start (const callback_type& callback);
+
+    // stop ()
+    // Effects: stops the thread started by start(), if any.
+    void stop ();
+
+private:
+    watcher (const watcher&);			// not defined
+    watcher& operator= (const watcher&);	// not defined
+
+    void m_run ();
+
+    backend_t					m_type;
+    std::unique_ptr<detail::watch_backend>	m_backend;
+    callback_type				m_callback;
+    std::thread					m_thread;
+    sys::atomic<bool>				m_stopping;
+};
+
+} // namespace sys
+
+#endif /* SYSPP_SYSWATCH_H */
@@ -0,0 +1,101 @@
+// -*- C++ -*-
+//! \file       test/atomic_read.cc
+//! \brief      contended reads of a shared counter: plain load against CAS.
+//
+// Build: c++ -std=c++17 -O2 -I.. atomic_read.cc -lpthread && ./a.out [THREADS]
+//
+// THREADS readers (default: number of hardware threads) read one shared
+// value while a writer increments it every microsecond or so.  Reads are
+// done by sys::atomic<T>::load, by sys::atomic_get and by compare-and-swap
+// of the value with itself, which is how atomic_get was implemented
+// before; the latter takes the cache line exclusively on every read.
+// Speedup shows only with several CPUs.
+//
+
+#include "sysatomic.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const long reads_per_thread = 20000000;
+
+sys::atomic<sys::atomic_type>	shared_value (0);
+volatile sys::atomic_type	legacy_value = 0;
+sys::atomic<bool>		stop (false);
+
+struct load_read
+{
+    sys::atomic_type operator() () const { return shared_value.load (sys::memory_order_acquire); }
+    static void bump () { shared_value.fetch_add (1, sys::memory_order_relaxed); }
+};
+
+struct get_read
+{
+    sys::atomic_type operator() () const { return sys::atomic_get (legacy_value); }
+    static void bump () { sys::atomic_add (legacy_value, 1); }
+};
+
+struct cas_read
+{
+    sys::atomic_type operator() () const
+    {
+	sys::atomic_type expected = 0;
+	shared_value.compare_exchange (expected, 0);
+	return expected;
+    }
+    static void bump () { shared_value.fetch_add (1, sys::memory_order_relaxed); }
+};
+
+template <class Read>
+void reader (long* sum)
+{
+    Read read;
+    long s = 0;
+    for (long i = 0; i < reads_per_thread; ++i)
+	s += read();
+    *sum = s;
+}
+
+template <class Read>
+void run (const char* name, unsigned threads)
+{
+    stop.store (false);
+    std::thread writer ([] {
+	while (!stop.load (sys::memory_order_relaxed))
+	{
+	    Read::bump();
+	    std::this_thread::sleep_for (std::chrono::microseconds (1));
+	}
+    });
+    std::vector<long> sums (threads);
+    std::vector<std::thread> pool;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < threads; ++i)
+	pool.push_back (std::thread (reader<Read>, &sums[i]));
+    for (unsigned i = 0; i < threads; ++i)
+	pool[i].join();
+    double ns = std::chrono::duration<double, std::nano>
+	(std::chrono::steady_clock::now() - start).count();
+    stop.store (true);
+    writer.join();
+    std::printf ("%-22s %6.2f ns per read, %6.1f M reads/s total\n", name,
+		 ns * threads / (reads_per_thread * threads),
+		 reads_per_thread * threads / ns * 1e3);
+}
+
+} // anonymous namespace
+
+int main (int argc, char* argv[])
+{
+    unsigned threads = argc > 1 ? std::atoi (argv[1]) : std::thread::hardware_concurrency();
+    if (!threads)
+	threads = 1;
+    std::printf ("%u reader threads\n", threads);
+    run<load_read> ("atomic<T>::load", threads);
+    run<get_read> ("atomic_get", threads);
+    run<cas_read> ("compare_exchange read", threads);
+}
@@ -0,0 +1,69 @@
+// -*- C++ -*-
+//! \file       test/icase_hash.cc
+//! \brief      regression checks for seeded icase::hash.
+//
+// Build: c++ -std=c++17 -I.. icase_hash.cc && ./a.out
+//
+
+#include "icase.h"
+#include <cstdio>
+#include <cstring>
+#include <set>
+
+namespace {
+
+int failures = 0;
+
+void check (bool cond, const char* what, unsigned long long seed)
+{
+    if (!cond)
+    {
+	std::printf ("FAILED: %s (seed %llx)\n", what, seed);
+	++failures;
+    }
+}
+
+// keys that start with the hash round constant used to zero out the state of
+// the seeded hash, so that all of them collided for any seed.
+
+void cancelled_round (std::uint64_t seed)
+{
+    const std::uint64_t k1 = 0xe7037ed1a0b428dbull;
+    std::set<std::uint64_t> short_keys, long_keys;
+    for (int i = 0; i < 64; ++i)
+    {
+	char key[32];
+	std::memcpy (key, &k1, 8);
+	std::memset (key+8, 'A' + i % 26, 8);
+	key[8] = char ('0' + i);
+	short_keys.insert (icase::detail::hash_bytes (key, 16, seed));
+	std::memcpy (key+16, key, 16);
+	long_keys.insert (icase::detail::hash_bytes (key, 32, seed));
+    }
+    check (short_keys.size() == 64, "16-byte keys led by round constant collide", seed);
+    check (long_keys.size() == 64, "32-byte keys led by round constant collide", seed);
+}
+
+} // anonymous namespace
+
+int main ()
+{
+    const std::uint64_t seeds[] = { 1, 2, 0x9e3779b97f4a7c15ull, ~0ull };
+    std::set<std::uint64_t> across;
+    for (std::uint64_t seed : seeds)
+    {
+	cancelled_round (seed);
+	char key[16];
+	const std::uint64_t k1 = 0xe7037ed1a0b428dbull;
+	std::memcpy (key, &k1, 8);
+	std::memset (key+8, 'x', 8);
+	across.insert (icase::detail::hash_bytes (key, 16, seed));
+	check (icase::hash (seed) ("Hello, World") == icase::hash (seed) ("hELLO, wORLD"),
+	       "hash is case-sensitive", seed);
+    }
+    check (across.size() == sizeof(seeds)/sizeof(seeds[0]),
+	   "same key hashes equally for different seeds", 0);
+    if (!failures)
+	std::puts ("ok");
+    return failures != 0;
+}
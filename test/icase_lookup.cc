@@ -0,0 +1,115 @@
+// -*- C++ -*-
+//! \file       test/icase_lookup.cc
+//! \brief      lookup throughput of unordered_map keyed by icase::hash.
+//
+// Build: c++ -std=c++17 -O2 -I.. icase_lookup.cc && ./a.out [COUNT]
+//
+// COUNT similar-prefix keys (default 100000) are looked up in
+// std::unordered_map<std::string, int, HASH, icase::eqstr> in insertion and
+// in shuffled order, with icase::hash and with the djb2 hash it replaced.
+// Also reports raw hashing speed of long keys and number of distinct low 20
+// bits of hash values, which tells how well similar keys are spread.
+//
+
+#include "icase.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// the hash used by icase before, one byte at a time through toupper
+struct djb2_hash
+{
+    std::size_t operator() (const std::string& s) const
+    {
+	std::size_t h = 5381;
+	for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+	    h = h * 33 + std::toupper (static_cast<unsigned char> (*it));
+	return h;
+    }
+};
+
+typedef std::chrono::steady_clock clock;
+
+double ns_since (clock::time_point start, size_t ops)
+{
+    return std::chrono::duration<double, std::nano> (clock::now() - start).count() / ops;
+}
+
+template <class Hash>
+void lookups (const char* name, const std::vector<std::string>& keys,
+	      const std::vector<std::string>& shuffled)
+{
+    std::unordered_map<std::string, int, Hash, icase::eqstr> map;
+    for (size_t i = 0; i < keys.size(); ++i)
+	map[keys[i]] = int (i);
+
+    std::unordered_set<size_t> low_bits;
+    Hash hash;
+    for (size_t i = 0; i < keys.size(); ++i)
+	low_bits.insert (hash (keys[i]) & 0xfffff);
+
+    const int rounds = 10;
+    long found = 0;
+    clock::time_point start = clock::now();
+    for (int r = 0; r < rounds; ++r)
+	for (size_t i = 0; i < keys.size(); ++i)
+	    found += map.count (keys[i]);
+    double in_order = ns_since (start, rounds * keys.size());
+    start = clock::now();
+    for (int r = 0; r < rounds; ++r)
+	for (size_t i = 0; i < shuffled.size(); ++i)
+	    found += map.count (shuffled[i]);
+    double random = ns_since (start, rounds * keys.size());
+
+    std::printf ("%-12s in order %6.1f ns  shuffled %6.1f ns  distinct low bits %zu%s\n",
+		 name, in_order, random, low_bits.size(),
+		 found == long (2 * rounds * keys.size()) ? "" : "  LOOKUP FAILED");
+}
+
+template <class Hash>
+void throughput (const char* name, const std::string& key)
+{
+    const int rounds = 1000000;
+    Hash hash;
+    std::size_t sum = 0;
+    clock::time_point start = clock::now();
+    for (int r = 0; r < rounds; ++r)
+	sum += hash (key) + r;
+    double seconds = std::chrono::duration<double> (clock::now() - start).count();
+    std::printf ("%-12s %zu-byte keys %6.2f GB/s (%zx)\n", name, key.size(),
+		 key.size() * double (rounds) / seconds / 1e9, sum & 0xf);
+}
+
+} // anonymous namespace
+
+int main (int argc, char* argv[])
+{
+    size_t count = argc > 1 ? std::strtoul (argv[1], 0, 10) : 100000;
+    std::vector<std::string> keys;
+    keys.reserve (count);
+    char buf[64];
+    for (size_t i = 0; i < count; ++i)
+    {
+	std::snprintf (buf, sizeof(buf), "X-Custom-Header-%zu", i);
+	keys.push_back (buf);
+    }
+    std::vector<std::string> shuffled (keys);
+    std::shuffle (shuffled.begin(), shuffled.end(), std::mt19937 (1));
+    for (size_t i = 0; i < shuffled.size(); i += 2)
+	std::transform (shuffled[i].begin(), shuffled[i].end(), shuffled[i].begin(), ::tolower);
+
+    lookups<icase::hash> ("icase::hash", keys, shuffled);
+    lookups<djb2_hash> ("djb2", keys, shuffled);
+
+    std::string long_key (256, 'a');
+    throughput<icase::hash> ("icase::hash", long_key);
+    throughput<djb2_hash> ("djb2", long_key);
+}
@@ -0,0 +1,52 @@
+// -*- C++ -*-
+//! \file       test/walk_scale.cc
+//! \brief      scaling of sys::walk_tree with the number of threads.
+//
+// Build: c++ -std=c++17 -O2 -I.. walk_scale.cc ../syswalk.cc ../sysfs.cc
+//        ../sysuring.cc ../sysio.cc ../syserror.cc ../sysstring.cc
+//        ../timer.cc ../histogram.cc -lpthread && ./a.out [ROOT]
+//
+// Tree is walked once to warm up the dentry cache, then with 1, 2, 4, ...
+// threads up to twice the number of hardware threads.  Every run must find
+// the same number of entries.
+//
+
+#include "syswalk.h"
+#include "timer.hpp"
+#include <cstdio>
+#include <thread>
+
+int main (int argc, char* argv[])
+{
+    const char* root = argc > 1 ? argv[1] : "/usr";
+    unsigned hw = std::thread::hardware_concurrency();
+    if (!hw)
+	hw = 1;
+
+    std::function<void (std::vector<sys::walk_entry>&)> ignore
+	= [] (std::vector<sys::walk_entry>&) { };
+    sys::walk_options options;
+    options.threads = hw;
+    size_t expected = sys::walk_tree (root, ignore, options);
+
+    std::printf ("%s: %zu entries, %u hardware threads\n", root, expected, hw);
+    double base = 0;
+    int failures = 0;
+    for (unsigned threads = 1; threads <= 2 * hw; threads *= 2)
+    {
+	options.threads = threads;
+	sys::timer t;
+	size_t count = sys::walk_tree (root, ignore, options);
+	double elapsed = t.elapsed();
+	if (threads == 1)
+	    base = elapsed;
+	std::printf ("%3u threads: %8.1f ms  speedup %.2f\n",
+		     threads, elapsed * 1000, base / elapsed);
+	if (count != expected)
+	{
+	    std::printf ("FAILED: %zu entries instead of %zu\n", count, expected);
+	    ++failures;
+	}
+    }
+    return failures != 0;
+}
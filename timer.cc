@@ -1,7 +1,7 @@
 // -*- C++ -*-
 //! \file       timer.cc
 //! \date       Sat Jul 21 20:09:40 2007
-//! \brief      static members of sys::timer class.
+//! \brief      cycle_clock calibration and timing counters.
 //
 // Copyright (C) 2007 by poddav
 //
@@ -25,13 +25,125 @@
 //
 
 #include "timer.hpp"
+#include <memory>	// for std::unique_ptr
+#include <mutex>
 
-#if defined(_WIN32) || defined(HAS_POSIX_CLOCK)
+namespace sys {
 
-const sys::timer::detail sys::timer::sys_info;
+namespace {
 
-#else
+#if SYSPP_HAS_RDTSC
+
+// measure TSC frequency against steady clock
+double tsc_frequency ()
+{
+    typedef std::chrono::steady_clock clock;
+    const clock::duration interval = std::chrono::milliseconds (2);
+
+    clock::time_point start = clock::now();
+    cycle_clock::tick_type start_ticks = cycle_clock::now();
+    clock::time_point end;
+    cycle_clock::tick_type end_ticks;
+    do
+    {
+	end_ticks = cycle_clock::now();
+	end = clock::now();
+    }
+    while (end - start < interval);
+
+    double seconds = std::chrono::duration<double> (end - start).count();
+    return (end_ticks - start_ticks) / seconds;
+}
 
-namespace { int timer_sys_info_dummy; }
+#endif
+
+// list of registered timing counters
+std::mutex counters_lock;
+timing_counter* counters_head = 0;
 
+} // anonymous namespace
+
+cycle_clock::detail::
+detail ()
+{
+#if SYSPP_HAS_RDTSC
+    double freq = tsc_frequency();
+#elif defined(_WIN32)
+    LARGE_INTEGER count;
+    ::QueryPerformanceFrequency (&count);
+    double freq = double (count.QuadPart);
+#else
+    double freq = 1e9;
 #endif
+    period = 1 / freq;
+
+    // largest precision that keeps mult within 32 bits
+    double ns_per_tick = 1e9 / freq;
+    shift = 32;
+    while (shift > 0 && ns_per_tick * (tick_type (1) << shift) >= 4294967296.0)
+	--shift;
+    mult = tick_type (ns_per_tick * (tick_type (1) << shift) + 0.5);
+}
+
+const cycle_clock::detail& cycle_clock::
+sys_info ()
+{
+    // not calibrated in static initializer, which would delay every process
+    // and leave mult zero to callers initialized earlier
+    static const detail info;
+    return info;
+}
+
+timing_counter::
+timing_counter (const char* name, bool trace)
+    : m_name (name), m_trace (trace)
+{
+    std::lock_guard<std::mutex> lock (counters_lock);
+    m_next = counters_head;
+    counters_head = this;
+}
+
+timing_counter::
+~timing_counter ()
+{
+    std::lock_guard<std::mutex> lock (counters_lock);
+    for (timing_counter** link = &counters_head; *link; link = &(*link)->m_next)
+    {
+	if (*link == this)
+	{
+	    *link = m_next;
+	    break;
+	}
+    }
+}
+
+void timing_counter::
+collect (std::vector<stats>& out)
+{
+    std::lock_guard<std::mutex> lock (counters_lock);
+    for (timing_counter* counter = counters_head; counter; counter = counter->m_next)
+    {
+	stats s = { counter->name(), counter->count(), counter->total() };
+	out.push_back (s);
+    }
+}
+
+void timing_ring::
+copy (std::vector<sample>& out) const
+{
+    size_t count = size();
+    size_t first = size_t ((m_count - count) % capacity);
+    for (size_t i = 0; i < count; ++i)
+	out.push_back (m_samples[(first + i) % capacity]);
+}
+
+timing_ring& timing_ring::
+this_thread ()
+{
+    static thread_local std::unique_ptr<timing_ring> ring;
+    if (!ring)
+	ring.reset (new timing_ring);
+    return *ring;
+}
+
+} // namespace sys
@@ -3,7 +3,7 @@
 //! \date       Sat Jul 21 20:07:38 2007
 //! \brief      high-performance timer that measures elapsed time.
 //
-// Uses same interface as boost::timer.
+// sys::timer uses same interface as boost::timer.
 //
 // Copyright (C) 2007 by poddav
 //
@@ -30,137 +30,291 @@
 #define SYS_TIMER_HPP
 
 #include "sysdef.h"
+#include "sysatomic.h"		// for sys::uatomic64
 #include <limits>		// for std::numeric_limits
+#include <vector>
+#include <chrono>		// for std::chrono::nanoseconds
 #include <boost/cstdint.hpp>	// for boost::uint64_t
-#ifdef _WIN32
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SYSPP_HAS_RDTSC 1
+#ifdef _MSC_VER
+#include <intrin.h>	// for __rdtsc
+#endif
+#elif defined(_WIN32)
 #include <windows.h>
-#elif defined(HAS_POSIX_CLOCK)
+#elif HAS_POSIX_CLOCK
 #include <time.h>
-#else
-#include <boost/timer.hpp>
 #endif
-#include "syserror.h"
 
 namespace sys {
 
-#ifdef _WIN32
-
-class SYSPP_DLLIMPORT timer
+// ---------------------------------------------------------------------------
+/// \class cycle_clock
+/// \brief processor cycle counter.
+///
+/// Reads time-stamp counter on x86 processors, which takes a few
+/// nanoseconds and involves no system calls; other platforms use system
+/// monotonic clock.  Tick frequency is calibrated against the system clock
+/// on the first conversion of ticks, which spins for about 2 ms.  TSC is
+/// assumed to run at constant rate, which is the case for any x86 processor
+/// of the last decade.
+
+class SYSPP_DLLIMPORT cycle_clock
 {
 public:
-    typedef boost::uint64_t clock_t;
+    typedef boost::uint64_t		tick_type;
+    typedef std::chrono::nanoseconds	duration;
 
-    // default ctor
-    // Postconditions: elapsed() == 0
-    timer ()
+    // now ()
+    // Returns: current tick count.
+
+    static tick_type now ()
 	{
-	    if (!sys_info.sys_freq)
-		SYS_THROW_GENERIC_ERROR ("high-resolution timer not available");
-	    detail::query (_start_time);
+#if SYSPP_HAS_RDTSC && defined(_MSC_VER)
+	    return __rdtsc();
+#elif SYSPP_HAS_RDTSC
+	    return __builtin_ia32_rdtsc();
+#elif defined(_WIN32)
+	    LARGE_INTEGER count;
+	    ::QueryPerformanceCounter (&count);
+	    return count.QuadPart;
+#elif HAS_POSIX_CLOCK
+	    struct timespec ts;
+	    ::clock_gettime (CLOCK_MONOTONIC, &ts);
+	    return tick_type (ts.tv_sec) * 1000000000u + ts.tv_nsec;
+#else
+	    return std::chrono::duration_cast<duration>
+		(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
 	}
 
-    // restart()
-    // Postconditions: elapsed() == 0
-    void restart () { detail::query (_start_time); }
-
-    double elapsed () const                  // return elapsed time in seconds
-	{
-	    clock_t current;
-	    detail::query (current);
-	    return double(current - _start_time) / sys_info.sys_freq;
-       	}
+    // to_duration (TICKS)
+    // Returns: TICKS converted to nanoseconds, using integer arithmetic only.
 
-    double elapsed_max() const // return estimated maximum value for elapsed()
-    // Portability warning: elapsed_max() may return too high a value on systems
-    // where clock_t overflows or resets at surprising values.
+    static duration to_duration (tick_type ticks)
 	{
-	    return (double (std::numeric_limits<clock_t>::max())
-		    - double(_start_time)) / double(sys_info.sys_freq); 
+	    const detail& info = sys_info();
+	    tick_type hi = ticks >> 32, lo = ticks & 0xffffffffu;
+	    return duration (((hi * info.mult) << (32 - info.shift))
+			     + ((lo * info.mult) >> info.shift));
 	}
 
-    static double elapsed_min() // return minimum value for elapsed()
-	{ return 1.0/double(sys_info.sys_freq); }
+    // to_seconds (TICKS)
+    // Returns: TICKS converted to seconds.
+
+    static double to_seconds (tick_type ticks) { return ticks * sys_info().period; }
+
+    // frequency ()
+    // Returns: number of ticks per second.
+
+    static double frequency () { return 1 / sys_info().period; }
 
 private:
     struct SYSPP_DLLIMPORT detail
     {
-	clock_t sys_freq;
-
-	detail () : sys_freq (0)
-       	{ ::QueryPerformanceFrequency ((LARGE_INTEGER*)&sys_freq); }
+	tick_type	mult;	// nanoseconds per tick, fixed point
+	unsigned	shift;	// number of fractional bits in mult
+	double		period;	// seconds per tick
 
-	static void query (clock_t& t)
-	{ ::QueryPerformanceCounter ((LARGE_INTEGER*)&t); }
+	detail ();
     };
 
-    static const detail sys_info;
+    // sys_info ()
+    // Returns: clock parameters, calibrated on the first call.
 
-    clock_t	_start_time;
-}; // timer
+    static const detail& sys_info ();
+};
 
-#elif HAS_POSIX_CLOCK
+// ---------------------------------------------------------------------------
+/// \class timer
+/// \brief measures elapsed wall-clock time.
 
-class SYSPP_DLLIMPORT timer
+class timer
 {
 public:
-    typedef struct timespec clock_t;
+    typedef cycle_clock::tick_type clock_t;
 
     // default ctor
     // Postconditions: elapsed() == 0
-    timer ()
-	{
-	    if (!sys_info.sys_res.tv_nsec)
-		SYS_THROW_GENERIC_ERROR ("high-resolution timer not available");
-	    detail::query (_start_time);
-	}
+    timer () : _start_time (cycle_clock::now()) { }
 
     // restart()
     // Postconditions: elapsed() == 0
-    void restart () { detail::query (_start_time); }
+    void restart () { _start_time = cycle_clock::now(); }
 
     double elapsed () const                  // return elapsed time in seconds
-	{
-	    clock_t current;
-	    detail::query (current);
-	    double diff_nsec = double (current.tv_nsec - _start_time.tv_nsec) / 1e9;
-	    if (current.tv_sec == _start_time.tv_sec)
-    		return diff_nsec;
-	    else if (current.tv_sec > _start_time.tv_sec)
-		return diff_nsec + 1 + current.tv_sec - _start_time.tv_sec;
-	    else
-		return double (std::numeric_limits<time_t>::max() - _start_time.tv_sec)
-		    + current.tv_sec + diff_nsec + 2;
-       	}
+	{ return cycle_clock::to_seconds (cycle_clock::now() - _start_time); }
+
+    cycle_clock::duration elapsed_ns () const // return elapsed time in nanoseconds
+	{ return cycle_clock::to_duration (cycle_clock::now() - _start_time); }
+
+    clock_t elapsed_ticks () const	     // return elapsed time in clock ticks
+	{ return cycle_clock::now() - _start_time; }
 
     double elapsed_max() const // return estimated maximum value for elapsed()
-	{ return double (std::numeric_limits<time_t>::max()); }
+	{ return cycle_clock::to_seconds (std::numeric_limits<clock_t>::max() - _start_time); }
 
     static double elapsed_min() // return minimum value for elapsed()
-	{ return sys_info.sys_res.tv_nsec / 1e9; }
+	{ return cycle_clock::to_seconds (1); }
 
 private:
-    struct SYSPP_DLLIMPORT detail
+    clock_t	_start_time;
+}; // timer
+
+// ---------------------------------------------------------------------------
+/// \class timing_counter
+/// \brief named accumulator of time spent in instrumented code.
+///
+/// Counters register themselves in the global list on construction, so that
+/// collect() could report all of them.  Counters are usually static objects,
+/// see SYSPP_TIMED_SCOPE.
+
+class SYSPP_DLLIMPORT timing_counter
+{
+public:
+    struct stats
     {
-	clock_t	    sys_res;
+	const char*		name;
+	boost::uint64_t		count;
+	cycle_clock::duration	total;
+    };
+
+    // timing_counter (NAME, TRACE)
+    // Effects: registers counter NAME.  If TRACE is true, scoped_timer also
+    //          records each sample into the timing_ring of the calling thread.
+
+    explicit timing_counter (const char* name, bool trace = false);
+    ~timing_counter ();
 
-	detail () : sys_res {0,0}
-       	{ ::clock_getres (CLOCK_MONOTONIC, &sys_res); }
+    const char* name () const { return m_name; }
+    bool traced () const { return m_trace; }
 
-	static void query (clock_t& t)
-	{ ::clock_gettime (CLOCK_MONOTONIC, &t); }
+    boost::uint64_t count () const { return m_count.load (memory_order_relaxed); }
+    cycle_clock::duration total () const
+	{ return cycle_clock::to_duration (m_ticks.load (memory_order_relaxed)); }
+
+    // add (TICKS)
+    // Effects: accounts one sample of TICKS duration.
+
+    void add (cycle_clock::tick_type ticks)
+	{
+	    m_count.fetch_add (1, memory_order_relaxed);
+	    m_ticks.fetch_add (ticks, memory_order_relaxed);
+	}
+
+    void reset ()
+	{
+	    m_count.store (0, memory_order_relaxed);
+	    m_ticks.store (0, memory_order_relaxed);
+	}
+
+    // collect (OUT)
+    // Effects: appends statistics of all registered counters to OUT.
+
+    static void collect (std::vector<stats>& out);
+
+private:
+    timing_counter (const timing_counter&);		// not defined
+    timing_counter& operator= (const timing_counter&);	// not defined
+
+    const char*		m_name;
+    bool		m_trace;
+    uatomic64		m_count;
+    uatomic64		m_ticks;
+    timing_counter*	m_next;
+};
+
+// ---------------------------------------------------------------------------
+/// \class timing_ring
+/// \brief fixed-size log of the most recent timing samples of a thread.
+///
+/// Ring is not synchronized and should be accessed by its owner thread only.
+
+class SYSPP_DLLIMPORT timing_ring
+{
+public:
+    enum { capacity = 1024 };
+
+    struct sample
+    {
+	const timing_counter*	counter;
+	cycle_clock::tick_type	start;
+	cycle_clock::tick_type	ticks;
     };
 
-    static const detail sys_info;
+    timing_ring () : m_count (0) { }
 
-    clock_t	_start_time;
-}; // timer
+    void push (const timing_counter* counter, cycle_clock::tick_type start,
+	       cycle_clock::tick_type ticks)
+	{
+	    sample& s = m_samples[m_count++ % capacity];
+	    s.counter = counter;
+	    s.start = start;
+	    s.ticks = ticks;
+	}
 
-#else
+    // size ()
+    // Returns: number of samples retained in the ring.
+    size_t size () const { return m_count < capacity ? size_t (m_count) : size_t (capacity); }
 
-using boost::timer;
+    // total ()
+    // Returns: number of samples pushed since last clear().
+    boost::uint64_t total () const { return m_count; }
 
-#endif
+    // copy (OUT)
+    // Effects: appends retained samples to OUT, oldest first.
+    void copy (std::vector<sample>& out) const;
+
+    void clear () { m_count = 0; }
+
+    // this_thread ()
+    // Returns: ring of the calling thread, allocated on first use.
+    static timing_ring& this_thread ();
+
+private:
+    boost::uint64_t	m_count;
+    sample		m_samples[capacity];
+};
+
+/// \class scoped_timer
+/// \brief accumulates time spent within its lifetime into timing_counter.
+
+class scoped_timer
+{
+public:
+    explicit scoped_timer (timing_counter& counter)
+	: m_counter (counter), m_start (cycle_clock::now()) { }
+
+    ~scoped_timer ()
+	{
+	    cycle_clock::tick_type ticks = cycle_clock::now() - m_start;
+	    m_counter.add (ticks);
+	    if (m_counter.traced())
+		timing_ring::this_thread().push (&m_counter, m_start, ticks);
+	}
+
+private:
+    scoped_timer (const scoped_timer&);			// not defined
+    scoped_timer& operator= (const scoped_timer&);	// not defined
+
+    timing_counter&		m_counter;
+    cycle_clock::tick_type	m_start;
+};
 
 } // namespace sys
 
+// SYSPP_TIMED_SCOPE (NAME)
+// Effects: accumulates time spent in the rest of enclosing scope into static
+//          counter NAME.  Expands to nothing unless SYSPP_ENABLE_TIMING is
+//          defined, so library hot paths are instrumented at no cost.
+
+#ifdef SYSPP_ENABLE_TIMING
+#define SYSPP_TIMED_SCOPE(name) \
+    static ::sys::timing_counter syspp_timing_counter_ (name); \
+    ::sys::scoped_timer syspp_scoped_timer_ (syspp_timing_counter_)
+#else
+#define SYSPP_TIMED_SCOPE(name)
+#endif
+
 #endif /* SYS_TIMER_HPP */